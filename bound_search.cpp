@@ -0,0 +1,155 @@
+/*******************************************************************************
+Copyright 2013 Advanced Micro Devices, Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1 Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+2 Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+/**
+********************************************************************************
+* @file <bound_search.cpp>
+*
+* @brief This file contains the nearest key queries on the cpu: lower bound,
+* upper bound, predecessor and successor of a batch of keys. Each query is a
+* single walk from the root that remembers the last node on the right side
+* of the key, so it costs the same as an exact search. The batch is split
+* over the thread pool the same way as multithreaded_search.
+*
+********************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "cpu_BST.h"
+#include "thread_pool.h"
+#include "epoch.h"
+#include "bound_search.h"
+
+typedef struct _bound_arg
+{
+	node *root;
+	int *keys;
+	int query;
+	node **found_keys;
+} bound_arg;
+
+/* Smallest node above key (at or above it unless strict), deleted nodes
+ * included. */
+static node *ceil_node(node *root, int key, int strict)
+{
+	node *tmp_node = root;
+	node *best = NULL;
+
+	while (tmp_node) {
+		if (key < tmp_node->value || (!strict && key == tmp_node->value)) {
+			best = tmp_node;
+			tmp_node = bst_load_ptr(&tmp_node->left);
+		}
+		else {
+			tmp_node = bst_load_ptr(&tmp_node->right);
+		}
+	}
+
+	return best;
+}
+
+/* Largest node below key, deleted nodes included. */
+static node *floor_node(node *root, int key)
+{
+	node *tmp_node = root;
+	node *best = NULL;
+
+	while (tmp_node) {
+		if (tmp_node->value < key) {
+			best = tmp_node;
+			tmp_node = bst_load_ptr(&tmp_node->right);
+		}
+		else {
+			tmp_node = bst_load_ptr(&tmp_node->left);
+		}
+	}
+
+	return best;
+}
+
+/* Answers one query, NULL if no key of the tree satisfies it. A deleted
+ * node that still routes the searches is stepped over to its neighbour in
+ * key order, so a live duplicate of its key is not skipped. */
+node *bound_node(node *root, int key, int query)
+{
+	node *tmp_node;
+
+	switch (query) {
+	case BOUND_LOWER:
+		tmp_node = ceil_node(root, key, 0);
+		break;
+	case BOUND_PREDECESSOR:
+		tmp_node = floor_node(root, key);
+		while (tmp_node && bst_load_int(&tmp_node->deleted))
+			tmp_node = prev_inorder(tmp_node);
+		return tmp_node;
+	default:
+		tmp_node = ceil_node(root, key, 1);
+		break;
+	}
+
+	while (tmp_node && bst_load_int(&tmp_node->deleted))
+		tmp_node = next_inorder(tmp_node);
+
+	return tmp_node;
+}
+
+static void bound_range(void *arg, int begin, int end, int worker_id)
+{
+	bound_arg *barg = (bound_arg *)arg;
+
+	epoch_enter();
+	for (int i = begin; i < end; i++) {
+		barg->found_keys[i] = bound_node(barg->root, barg->keys[i], barg->query);
+	}
+	epoch_exit();
+}
+
+/* Runs the query for every key of the batch on the thread pool,
+ * found_keys[i] is the answer for keys[i]. */
+void multithreaded_bound_search(node *root, int *keys, int key_array_size, int num_thread, int query, node **found_keys)
+{
+	bound_arg barg;
+
+	barg.root = root;
+	barg.keys = keys;
+	barg.query = query;
+	barg.found_keys = found_keys;
+
+	thread_pool_init(num_thread);
+	thread_pool_run(bound_range, &barg, key_array_size);
+}
+
+const char *bound_query_name(int query)
+{
+	switch (query) {
+	case BOUND_LOWER:		return "lower_bound";
+	case BOUND_UPPER:		return "upper_bound";
+	case BOUND_PREDECESSOR:	return "predecessor";
+	case BOUND_SUCCESSOR:	return "successor";
+	default:				return "exact";
+	}
+}
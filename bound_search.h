@@ -0,0 +1,11 @@
+#ifndef BOUND_SEARCH_H_
+#define BOUND_SEARCH_H_
+
+#include "hsa_BST_search.h"
+#include "ocl_BST_search.h"
+
+node *bound_node(node *root, int key, int query);
+void multithreaded_bound_search(node *root, int *keys, int key_array_size, int num_thread, int query, node **found_keys);
+const char *bound_query_name(int query);
+
+#endif
@@ -44,7 +44,8 @@ __kernel void bst_insert(
 		}
 
 		tmp_parent = tmp_node;
-		flag = (new_node->value - tmp_node->value);
+		/* Compare, a subtraction overflows for keys far apart */
+		flag = (new_node->value < tmp_node->value) ? -1 : 1;
 		tmp_node = (flag < 0) ? tmp_node->left : tmp_node->right;
 	}
 	
@@ -114,7 +115,7 @@ __kernel void bst_insert(
 
 				/* A small traversal is needed again */
 				tmp_parent = tmp_node;
-				flag = (new_node->value - tmp_node->value);
+				flag = (new_node->value < tmp_node->value) ? -1 : 1;
 				tmp_node = (flag < 0) ? tmp_node->left : tmp_node->right;
 			}
 		}
@@ -122,6 +123,49 @@ __kernel void bst_insert(
 }
 
 
+/* Next node in key order, NULL after the largest */
+__global node *next_inorder(__global node *tmp_node)
+{
+	__global node *parent;
+
+	if (tmp_node->right) {
+		tmp_node = tmp_node->right;
+		while (tmp_node->left)
+			tmp_node = tmp_node->left;
+		return tmp_node;
+	}
+
+	parent = tmp_node->parent;
+	while (parent && tmp_node == parent->right) {
+		tmp_node = parent;
+		parent = parent->parent;
+	}
+
+	return parent;
+}
+
+/* Live node with the key below a deleted one, as search_deleted_equal
+ * in cpu_BST.cpp: the equal keys can be on both sides of it. */
+__global node *search_deleted_equal(__global node *tmp_node, int key)
+{
+	__global node *best = tmp_node;
+	__global node *cur = tmp_node->left;
+
+	while (cur) {
+		if (key <= cur->value) {
+			best = cur;
+			cur = cur->left;
+		}
+		else {
+			cur = cur->right;
+		}
+	}
+
+	while (best && best->value == key && best->deleted)
+		best = next_inorder(best);
+
+	return (best && best->value == key) ? best : (__global node *)0;
+}
 
 /*
  * This kernel searched a set of nodes on an BST.
@@ -155,11 +199,14 @@ __kernel void bst_search(
 		tmp_node = root;
 	
 		while (1) {
-			if (!tmp_node || (tmp_node->value == key))
+			if (!tmp_node || tmp_node->value == key)
 				break;
 
 			tmp_node = (key < tmp_node->value) ? tmp_node->left : tmp_node->right;
 		}
+
+		if (tmp_node && tmp_node->deleted)
+			tmp_node = search_deleted_equal(tmp_node, key);
 	
 		found_nodes[init_id + i] = tmp_node;
 	}
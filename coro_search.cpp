@@ -0,0 +1,210 @@
+/*******************************************************************************
+Copyright 2013 Advanced Micro Devices, Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1 Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+2 Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+/**
+********************************************************************************
+* @file <coro_search.cpp>
+*
+* @brief This file contains the coroutine based interleaved search on the cpu.
+* Each key is looked up by a coroutine that prefetches the next child and
+* suspends. A scheduler keeps a group of them in flight and resumes them
+* round robin, which gives the same latency hiding as interleaved_search()
+* without the hand written state machine.
+*
+********************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "cpu_BST.h"
+#include "coro_search.h"
+#include "interleaved_search.h"
+
+#ifdef BST_HAVE_COROUTINES
+
+#include <coroutine>
+#include <exception>
+
+/* Coroutine frames all have the same size. They are recycled through a per
+ * thread free list so a lookup does not pay for a heap allocation. The list
+ * is released when the thread exits. */
+typedef struct _frame_block
+{
+	struct _frame_block *next;
+} frame_block;
+
+struct frame_cache
+{
+	frame_block *head;
+	size_t size;
+
+	~frame_cache()
+	{
+		while (head) {
+			frame_block *block = head;
+			head = block->next;
+			free(block);
+		}
+	}
+};
+
+static thread_local frame_cache frames = { NULL, 0 };
+
+struct lookup_task
+{
+	struct promise_type
+	{
+		lookup_task get_return_object()
+		{
+			return lookup_task(std::coroutine_handle<promise_type>::from_promise(*this));
+		}
+
+		std::suspend_always initial_suspend() noexcept { return std::suspend_always(); }
+		std::suspend_always final_suspend() noexcept { return std::suspend_always(); }
+		void return_void() {}
+		void unhandled_exception() { std::terminate(); }
+
+		static void *operator new(size_t size)
+		{
+			if (frames.head && size == frames.size) {
+				frame_block *block = frames.head;
+				frames.head = block->next;
+				return block;
+			}
+
+			void *p = malloc(size);
+			if (p == NULL) {
+				printf("Error allocating memory for coroutine frame.\n");
+				exit(1);
+			}
+			frames.size = size;
+			return p;
+		}
+
+		static void operator delete(void *p, size_t size)
+		{
+			if (size != frames.size) {
+				free(p);
+				return;
+			}
+
+			frame_block *block = (frame_block *)p;
+			block->next = frames.head;
+			frames.head = block;
+		}
+	};
+
+	explicit lookup_task(std::coroutine_handle<promise_type> h) : handle(h) {}
+
+	std::coroutine_handle<promise_type> handle;
+};
+
+static lookup_task lookup(node *root, int key, node **result)
+{
+	node *tmp_node = root;
+
+	while (1) {
+		if (!tmp_node || tmp_node->value == key)
+			break;
+
+		tmp_node = bst_load_ptr((key < tmp_node->value) ? &tmp_node->left : &tmp_node->right);
+		if (tmp_node) {
+			BST_PREFETCH(tmp_node);
+			co_await std::suspend_always();
+		}
+	}
+
+	if (tmp_node && bst_load_int(&tmp_node->deleted))
+		tmp_node = search_deleted_equal(tmp_node, key);
+	*result = tmp_node;
+}
+
+int coro_search_available(void)
+{
+	return 1;
+}
+
+void coro_search(node *root, const top_levels *top, int *keys, node **found_keys, int begin, int end, int group_size)
+{
+	std::coroutine_handle<lookup_task::promise_type> group[MAX_INTERLEAVE_GROUP];
+	int next = begin;
+	int active = 0;
+	node *start;
+
+	if (group_size < 1)
+		group_size = 1;
+	else if (group_size > MAX_INTERLEAVE_GROUP)
+		group_size = MAX_INTERLEAVE_GROUP;
+
+	for (int g = 0; g < group_size; g++) {
+		if (next < end) {
+			group[g] = lookup(top_levels_start(top, root, keys[next]), keys[next], &found_keys[next]).handle;
+			next++;
+			active++;
+		}
+		else {
+			group[g] = NULL;
+		}
+	}
+
+	while (active) {
+		for (int g = 0; g < group_size; g++) {
+			if (!group[g])
+				continue;
+
+			group[g].resume();
+			if (!group[g].done())
+				continue;
+
+			group[g].destroy();
+			if (next < end) {
+				/* The lookup starts running on the next round */
+				start = top_levels_start(top, root, keys[next]);
+				if (top && start)
+					BST_PREFETCH(start);
+				group[g] = lookup(start, keys[next], &found_keys[next]).handle;
+				next++;
+			}
+			else {
+				group[g] = NULL;
+				active--;
+			}
+		}
+	}
+}
+
+#else /* BST_HAVE_COROUTINES */
+
+int coro_search_available(void)
+{
+	return 0;
+}
+
+void coro_search(node *root, const top_levels *top, int *keys, node **found_keys, int begin, int end, int group_size)
+{
+	interleaved_search(root, top, keys, found_keys, begin, end, group_size);
+}
+
+#endif /* BST_HAVE_COROUTINES */
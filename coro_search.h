@@ -0,0 +1,15 @@
+#ifndef CORO_SEARCH_H_
+#define CORO_SEARCH_H_
+
+#include "hsa_BST_search.h"
+#include "top_levels.h"
+
+/* The coroutine engine needs compiler support for C++20 coroutines. */
+#if defined(__cpp_impl_coroutine) && (__cpp_impl_coroutine >= 201902L)
+#define BST_HAVE_COROUTINES 1
+#endif
+
+int coro_search_available(void);
+void coro_search(node *root, const top_levels *top, int *keys, node **found_keys, int begin, int end, int group_size);
+
+#endif
@@ -33,12 +33,89 @@ THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <stdio.h>
-#include <process.h>
-#include <windows.h>
-#include "cpu_bst.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <atomic>
+#include <mutex>
+#include "cpu_BST.h"
+#include "thread_pool.h"
+#include "radix_sort.h"
+#include "interleaved_search.h"
+#include "coro_search.h"
+#include "eytzinger.h"
+#include "veb_layout.h"
+#include "kary_tree.h"
+#include "epoch.h"
+#include "workload.h"
+#include "hot_cache.h"
+#include "top_levels.h"
+#include "numa_replica.h"
 
 #define MULTITHREAD
 
+static int cur_search_engine = SEARCH_ENGINE_POINTER;
+static int interleave_group = 16;
+
+/* Search layouts built from the pointer tree by prepare_search_engine() */
+static node *layout_root = NULL;
+static eytzinger_tree *eyt_tree = NULL;
+static veb_tree *veb = NULL;
+static kary_tree *kary = NULL;
+
+/* BFS array as ocl_node (tree), ocl_compact_node (compact) or SoA (soa) */
+typedef struct _bfs_array
+{
+	ocl_node *tree;
+	ocl_compact_node *compact;
+	ocl_soa_tree *soa;
+	node **nodes;
+	int root_id;
+	int count;
+} bfs_array;
+
+static bfs_array *bfs = NULL;
+
+/* Copies of the BFS array on every NUMA node. The nodes array is shared,
+ * it is read only for the keys found. */
+static bfs_array *bfs_replicas[NUMA_MAX_NODES];
+static int num_replicas = 0;
+static int numa_mode = NUMA_REPLICA_OFF;
+
+/* Replica of the top levels descended first by the pointer tree engines,
+ * built by prepare_search_engine() when top_levels_wanted is set */
+static top_levels *replica = NULL;
+static int top_levels_wanted = 0;
+
+/* Writers that unlink nodes are serialized by write_lock. tree_version
+ * counts the changes, a layout or hot key cache filled from an older
+ * version is rebuilt. */
+static std::mutex write_lock;
+static std::atomic<long long> tree_version(0);
+static long long layout_version = -1;
+
+static node make_dead_leaf(void)
+{
+	node leaf;
+
+	memset(&leaf, 0, sizeof(node));
+	leaf.deleted = 1;
+
+	return leaf;
+}
+
+/* Put in the NULL child slots of a node being unlinked so that a concurrent
+ * lockfree_insert cannot hang a new node below it. The sentinel never
+ * matches a search and has no children. */
+static node dead_leaf = make_dead_leaf();
+
+/* The subtree sizes are only kept with BST_SUBTREE_SIZE */
+static inline void set_size(node *tmp_node, int size)
+{
+#ifdef BST_SUBTREE_SIZE
+	tmp_node->size = size;
+#endif
+}
 
 static int iterative_insert(node **root, node *new_node)
 {
@@ -46,218 +123,1496 @@ static int iterative_insert(node **root, node *new_node)
 	int key;
 	key = new_node->value;
 
-	if (!(*root)) {
-		*root = new_node;
-		return 0;
+	set_size(new_node, 1);
+
+	if (!(*root)) {
+		new_node->parent = NULL;
+		*root = new_node;
+		return 0;
+	}
+
+	tmp = *root;
+
+	while (1) {
+#ifdef BST_SUBTREE_SIZE
+		/* The new node ends up below tmp */
+		tmp->size++;
+#endif
+
+		if (key < tmp->value) {
+			if (tmp->left == NULL) {
+				tmp->left = new_node;
+				break;
+			}
+			else {
+				tmp = tmp->left;
+			}
+		}
+
+		else {
+			if (tmp->right == NULL) {
+				tmp->right = new_node;
+				break;
+			}
+			else {
+				tmp = tmp->right;
+			}
+		}
+	}	
+
+	/* delete_node unlinks through the parent links */
+	new_node->parent = tmp;
+
+	return 0;
+}
+
+/* Inserts new_node with a CAS on the NULL child slot it belongs in, so any
+ * number of threads can insert at once without locks. A node is fully set
+ * up before the CAS publishes it, so search_node running at the same time
+ * sees either the old tree or the tree with the new leaf. The child slots
+ * are read with acquire loads, which pair with the CAS of the thread that
+ * filled them, so the node found there is fully set up. When the CAS
+ * loses, the walk carries on from the node that won the slot, or from the
+ * root if the slot belongs to a node being deleted. With count_sizes and
+ * BST_SUBTREE_SIZE the new leaf is added to the subtree size of each
+ * ancestor. A batch leaves
+ * that out, every insert would add to the root's size. The batch then
+ * recounts the sizes once at the end. */
+static void cas_insert(node **root, node *new_node, int count_sizes)
+{
+	node **slot = root;
+	node *parent = NULL;
+	node *cur;
+	int key = new_node->value;
+
+	bst_store_ptr(&new_node->left, NULL);
+	new_node->right = NULL;
+	new_node->height = 1;
+	new_node->deleted = 0;
+	set_size(new_node, 1);
+
+	cur = bst_load_ptr(slot);
+	while (1) {
+		/* The node above is being unlinked by delete_node, start over */
+		if (cur == &dead_leaf) {
+			slot = root;
+			parent = NULL;
+			cur = bst_load_ptr(slot);
+			continue;
+		}
+
+		if (!cur) {
+			new_node->parent = parent;
+			cur = bst_cas_ptr(slot, NULL, new_node);
+			if (!cur) {
+#ifdef BST_SUBTREE_SIZE
+				/* The subtree sizes above the new leaf are exact once
+				 * the concurrent inserts are done */
+				for (; parent && count_sizes; parent = parent->parent)
+					bst_atomic_add(&parent->size, 1);
+#endif
+				return;
+			}
+			continue;
+		}
+
+		parent = cur;
+		slot = (key < cur->value) ? &cur->left : &cur->right;
+		cur = bst_load_ptr(slot);
+	}
+}
+
+/* Node linked into the tree for new_node: a node reclaimed from the
+ * deletes given the key of new_node, else new_node itself. Called inside a
+ * read section, as epoch_reuse_node() wants. */
+static node *insert_source(node *new_node)
+{
+	node *reused = epoch_reuse_node();
+
+	if (!reused)
+		return new_node;
+
+	reused->value = new_node->value;
+	reused->found = new_node->found;
+
+	return reused;
+}
+
+/* The insert walks the tree inside a read section, so delete_node cannot
+ * reclaim a node under it. A batch of inserts bumps the tree version once,
+ * in multithreaded_insert. Returns the node linked, which is a reclaimed
+ * node instead of new_node when the deletes left one. */
+node *lockfree_insert(node **root, node *new_node)
+{
+	epoch_enter();
+	new_node = insert_source(new_node);
+	cas_insert(root, new_node, 1);
+	epoch_exit();
+	tree_version++;
+
+	return new_node;
+}
+
+typedef struct _insert_arg
+{
+	node **root;
+	node *new_nodes;
+} insert_arg;
+
+static void insert_range(void *arg, int begin, int end, int worker_id)
+{
+	insert_arg *iarg = (insert_arg *)arg;
+
+	epoch_enter();
+	for (int i = begin; i < end; i++)
+		cas_insert(iarg->root, insert_source(&iarg->new_nodes[i]), 0);
+	epoch_exit();
+}
+
+/* Subtree roots RECOUNT_SPLIT_DEPTH levels below the root, recounted in
+ * parallel before the levels above them */
+#define RECOUNT_SPLIT_DEPTH 10
+
+static inline node *real_child(node *child)
+{
+	return (child == &dead_leaf) ? NULL : child;
+}
+
+#ifdef BST_SUBTREE_SIZE
+/* Sets the size of every node of the subtree from its children, in post
+ * order through the parent links, so a degenerate subtree needs no stack. */
+static void recount_subtree(node *sub)
+{
+	node *cur = sub, *prev = NULL;
+	node *left, *right;
+
+	while (cur) {
+		left = real_child(cur->left);
+		right = real_child(cur->right);
+
+		/* Down into the subtrees not done yet */
+		if (prev == NULL || prev == cur->parent) {
+			prev = cur;
+			if (left) {
+				cur = left;
+				continue;
+			}
+			if (right) {
+				cur = right;
+				continue;
+			}
+		}
+		else if (prev == left && right) {
+			prev = cur;
+			cur = right;
+			continue;
+		}
+
+		cur->size = (left ? left->size : 0) + (right ? right->size : 0) + !cur->deleted;
+		if (cur == sub)
+			break;
+		prev = cur;
+		cur = cur->parent;
+	}
+}
+
+/* Sets the sizes of the levels above the recounted subtrees, returns the
+ * size of tmp_node */
+static int recount_top(node *tmp_node, int depth)
+{
+	if (!tmp_node || tmp_node == &dead_leaf)
+		return 0;
+
+	if (depth == RECOUNT_SPLIT_DEPTH)
+		return tmp_node->size;
+
+	tmp_node->size = recount_top(tmp_node->left, depth + 1) +
+		recount_top(tmp_node->right, depth + 1) + !tmp_node->deleted;
+
+	return tmp_node->size;
+}
+
+static void collect_subtrees(node *tmp_node, int depth, node **subtrees, int *count)
+{
+	if (!tmp_node || tmp_node == &dead_leaf)
+		return;
+
+	if (depth == RECOUNT_SPLIT_DEPTH) {
+		subtrees[(*count)++] = tmp_node;
+		return;
+	}
+
+	collect_subtrees(tmp_node->left, depth + 1, subtrees, count);
+	collect_subtrees(tmp_node->right, depth + 1, subtrees, count);
+}
+
+static void recount_range(void *arg, int begin, int end, int worker_id)
+{
+	node **subtrees = (node **)arg;
+
+	for (int i = begin; i < end; i++)
+		recount_subtree(subtrees[i]);
+}
+
+/* Recounts the subtree sizes after a batch of inserts that left them
+ * alone. The deep subtrees are recounted on the thread pool, then the
+ * levels above them. Deletes, which also change the sizes, wait until the
+ * sizes are exact. */
+static void recount_tree_sizes(node *root)
+{
+	node *subtrees[1 << RECOUNT_SPLIT_DEPTH];
+	int num_subtrees = 0;
+
+	std::lock_guard<std::mutex> guard(write_lock);
+
+	collect_subtrees(root, 0, subtrees, &num_subtrees);
+	thread_pool_run(recount_range, subtrees, num_subtrees);
+	recount_top(root, 0);
+}
+#endif
+
+/* Inserts the batch of nodes on the thread pool with lockfree_insert. The
+ * nodes reclaimed from the deletes go in first, the nodes of the batch they
+ * stand in for stay out of the tree. The pointer tree engines can search
+ * the tree while the batch goes in, the flattened layouts are snapshots and
+ * are rebuilt by the next prepare_search_engine() after the batch. */
+void multithreaded_insert(node **root, node *new_nodes, int num_nodes, int num_thread)
+{
+	insert_arg iarg;
+
+	iarg.root = root;
+	iarg.new_nodes = new_nodes;
+
+	thread_pool_init(num_thread);
+	thread_pool_run(insert_range, &iarg, num_nodes);
+#ifdef BST_SUBTREE_SIZE
+	recount_tree_sizes(*root);
+#endif
+	tree_version++;
+}
+
+static void recursive_insert(node **root, node *new_node)
+{
+	int key = new_node->value;
+
+	if(!(*root)) {
+		*root = new_node;
+		return;
+	}
+	else if(key < (*root)->value) {
+		recursive_insert(&(*root)->left, new_node);
+	}
+	else if(key >= (*root)->value) {
+		recursive_insert(&(*root)->right, new_node);
+	}
+
+	return;
+}
+
+node * construct_BST(int num_nodes, node *data)
+{
+	node *root = NULL;
+
+	/* Inserting nodes into tree */
+	for (int i = 0; i < num_nodes; i++)
+	{
+		iterative_insert(&root, &(data[i]));
+		//root = insert_and_balance(root, &(data[i]));
+	}
+	tree_version++;
+
+	return root;
+}
+
+typedef struct _gather_arg
+{
+	node *src;
+	node *dst;
+	int *perm;
+	int *keys;		// extract_keys_range writes the key of each src node here
+} gather_arg;
+
+static void gather_nodes_range(void *arg, int begin, int end, int worker_id)
+{
+	gather_arg *garg = (gather_arg *)arg;
+
+	for (int i = begin; i < end; i++)
+		garg->dst[i] = garg->src[garg->perm[i]];
+}
+
+static void copy_nodes_range(void *arg, int begin, int end, int worker_id)
+{
+	gather_arg *garg = (gather_arg *)arg;
+
+	memcpy(garg->dst + begin, garg->src + begin, (end - begin) * sizeof(node));
+}
+
+/* Links the sorted nodes [begin, end) into a balanced subtree under parent
+ * and returns its root. The middle node is the root, so the height is the
+ * bit length of end - begin. */
+static node *link_balanced(node *data, int begin, int end, node *parent)
+{
+	int mid, left_height, right_height;
+	node *tmp_node;
+
+	if (begin >= end)
+		return NULL;
+
+	mid = begin + (end - begin) / 2;
+	tmp_node = &data[mid];
+	tmp_node->parent = parent;
+	set_size(tmp_node, end - begin);
+	tmp_node->left = link_balanced(data, begin, mid, tmp_node);
+	tmp_node->right = link_balanced(data, mid + 1, end, tmp_node);
+
+	left_height = tmp_node->left ? tmp_node->left->height : 0;
+	right_height = tmp_node->right ? tmp_node->right->height : 0;
+	tmp_node->height = 1 + ((left_height > right_height) ? left_height : right_height);
+
+	return tmp_node;
+}
+
+static int bit_length(int n)
+{
+	int bits = 0;
+
+	while (n) {
+		bits++;
+		n >>= 1;
+	}
+
+	return bits;
+}
+
+/* A subtree below the top levels, linked by one pool item */
+typedef struct _subtree_task
+{
+	int begin;
+	int end;
+	node *parent;
+} subtree_task;
+
+typedef struct _link_arg
+{
+	node *data;
+	subtree_task *tasks;
+	int num_tasks;
+} link_arg;
+
+/* Links the top levels of the tree serially and records the subtrees at
+ * depth levels as tasks. Where the subtree roots will be is known from the
+ * ranges alone, so the top does not wait for the subtrees. */
+static node *link_top(link_arg *larg, int begin, int end, node *parent, int levels)
+{
+	int mid;
+	node *tmp_node;
+
+	if (begin >= end)
+		return NULL;
+
+	mid = begin + (end - begin) / 2;
+	tmp_node = &larg->data[mid];
+
+	if (!levels) {
+		larg->tasks[larg->num_tasks].begin = begin;
+		larg->tasks[larg->num_tasks].end = end;
+		larg->tasks[larg->num_tasks].parent = parent;
+		larg->num_tasks++;
+		return tmp_node;
+	}
+
+	tmp_node->parent = parent;
+	set_size(tmp_node, end - begin);
+	tmp_node->left = link_top(larg, begin, mid, tmp_node, levels - 1);
+	tmp_node->right = link_top(larg, mid + 1, end, tmp_node, levels - 1);
+	tmp_node->height = bit_length(end - begin);
+
+	return tmp_node;
+}
+
+static void link_subtree_range(void *arg, int begin, int end, int worker_id)
+{
+	link_arg *larg = (link_arg *)arg;
+
+	for (int i = begin; i < end; i++) {
+		subtree_task *task = &larg->tasks[i];
+		link_balanced(larg->data, task->begin, task->end, task->parent);
+	}
+}
+
+/* Fork-join linking of the sorted nodes: the top levels are split off until
+ * there are about 16 subtrees per pool worker, and the subtrees are linked
+ * in parallel with stealing between the workers. */
+static node *link_balanced_parallel(node *data, int num_nodes)
+{
+	link_arg larg;
+	node *root;
+	int levels = 0;
+
+	while ((1 << levels) < 16 * thread_pool_size() && levels < 16)
+		levels++;
+
+	if ((larg.tasks = (subtree_task *)malloc(((size_t)1 << levels) * sizeof(subtree_task))) == NULL) {
+		printf("Error allocating memory for bulk load.\n");
+		exit(1);
+	}
+	larg.data = data;
+	larg.num_tasks = 0;
+
+	root = link_top(&larg, 0, num_nodes, NULL, levels);
+	thread_pool_run(link_subtree_range, &larg, larg.num_tasks);
+
+	free(larg.tasks);
+
+	return root;
+}
+
+static void extract_keys_range(void *arg, int begin, int end, int worker_id)
+{
+	gather_arg *garg = (gather_arg *)arg;
+
+	for (int i = begin; i < end; i++)
+		garg->keys[i] = garg->src[i].value;
+}
+
+/* Builds a perfectly balanced tree from the nodes in data. The nodes are
+ * radix sorted by value in place, then linked in O(n) with the middle of
+ * every range as the subtree root. Every step runs on the thread pool, so
+ * the build scales with the number of workers. The node array is
+ * reordered, the nodes are in in-order sequence in memory afterwards. */
+node * bulk_load_BST(int num_nodes, node *data)
+{
+	gather_arg garg;
+	int *keys, *perm;
+	node *sorted;
+
+	if (num_nodes <= 0)
+		return NULL;
+
+	if ((keys = (int *)malloc(num_nodes * sizeof(int))) == NULL ||
+		(perm = (int *)malloc(num_nodes * sizeof(int))) == NULL ||
+		(sorted = (node *)malloc(num_nodes * sizeof(node))) == NULL) {
+		printf("Error allocating memory for bulk load.\n");
+		exit(1);
+	}
+
+	garg.src = data;
+	garg.keys = keys;
+	thread_pool_run(extract_keys_range, &garg, num_nodes);
+	radix_sort(keys, perm, num_nodes);
+	free(keys);
+
+	garg.src = data;
+	garg.dst = sorted;
+	garg.perm = perm;
+	thread_pool_run(gather_nodes_range, &garg, num_nodes);
+
+	garg.src = sorted;
+	garg.dst = data;
+	thread_pool_run(copy_nodes_range, &garg, num_nodes);
+
+	free(perm);
+	free(sorted);
+	tree_version++;
+
+	return link_balanced_parallel(data, num_nodes);
+}
+
+typedef struct _init_arg
+{
+	node *data;
+	uint64_t seed;
+} init_arg;
+
+static void initialize_nodes_range(void *arg, int begin, int end, int worker_id)
+{
+	init_arg *iarg = (init_arg *)arg;
+	node *tmp_node;
+
+	for (int i = begin; i < end; i++)
+	{
+		tmp_node = &(iarg->data[i]);
+
+		tmp_node->value = workload_key(iarg->seed, WORKLOAD_STREAM_NODES, i);
+		tmp_node->left = NULL;
+		tmp_node->right = NULL;
+		tmp_node->parent = NULL;
+		tmp_node->height = 1;
+		tmp_node->deleted = 0;
+		set_size(tmp_node, 1);
+	}
+}
+
+/* Sets up the nodes with uniform keys over [0, INT_MAX]. Node i gets the
+ * same key for a given seed whatever the number of pool threads. */
+void initialize_nodes(node *data, long long int num_nodes, uint64_t seed)
+{
+	init_arg iarg;
+
+	iarg.data = data;
+	iarg.seed = seed;
+	thread_pool_run(initialize_nodes_range, &iarg, (int)num_nodes);
+}
+
+
+void print_inorder(node * leaf) 
+{
+	if (leaf) {
+		print_inorder(leaf->left);
+		printf("%d ",leaf->value);
+		print_inorder(leaf->right);
+	}
+}
+
+static int node_count = 0;
+/* Returns true if the given tree is a BST and its */
+static int isBSTUtil(node* node, int min, int max) 
+{ 
+	if (node==NULL) 
+		return 1;
+
+	if (node->value < min || node->value > max) 
+		return 0; 
+
+	return isBSTUtil(node->left, min, node->value) && 
+			isBSTUtil(node->right, node->value, max);  
+}
+
+/* Returns true if a binary tree is a binary search tree */
+int isBST(node* node) 
+{ 
+	return isBSTUtil(node, INT_MIN, INT_MAX); 
+} 
+
+/* Number of live keys in the tree, kept in the subtree size of the root.
+ * Without BST_SUBTREE_SIZE the live nodes are counted by a walk. */
+int count_node(node *root)
+{
+#ifdef BST_SUBTREE_SIZE
+	return root ? root->size : 0;
+#else
+	node **live;
+	int count;
+
+	live = collect_live(root, &count);
+	free(live);
+
+	return count;
+#endif
+}
+
+/* Returns the nodes of the tree in sorted order in a malloced array of
+ * *count entries. The walk keeps its own stack, so degenerate trees do not
+ * overflow the call stack. */
+node **collect_inorder(node *root, int *count)
+{
+	node **sorted, **stack, **tmp;
+	node *cur = root;
+	long long sorted_size = 1024, stack_size = 64;
+	int n = 0, depth = 0;
+
+	if ((sorted = (node **)malloc(sorted_size * sizeof(node *))) == NULL ||
+		(stack = (node **)malloc(stack_size * sizeof(node *))) == NULL) {
+		printf("Error allocating memory for in-order walk.\n");
+		exit(1);
+	}
+
+	while (cur || depth) {
+		while (cur) {
+			if (depth == stack_size) {
+				stack_size *= 2;
+				if ((tmp = (node **)realloc(stack, stack_size * sizeof(node *))) == NULL) {
+					printf("Error allocating memory for in-order walk.\n");
+					exit(1);
+				}
+				stack = tmp;
+			}
+			stack[depth++] = cur;
+			cur = cur->left;
+		}
+
+		cur = stack[--depth];
+		if (n == sorted_size) {
+			sorted_size *= 2;
+			if ((tmp = (node **)realloc(sorted, sorted_size * sizeof(node *))) == NULL) {
+				printf("Error allocating memory for in-order walk.\n");
+				exit(1);
+			}
+			sorted = tmp;
+		}
+		sorted[n++] = cur;
+		cur = cur->right;
+	}
+
+	free(stack);
+	*count = n;
+
+	return sorted;
+}
+
+/* collect_inorder without the deleted nodes, for the layouts that are
+ * rebuilt from the sorted keys alone. */
+node **collect_live(node *root, int *count)
+{
+	node **sorted = collect_inorder(root, count);
+	int n = 0;
+
+	for (int i = 0; i < *count; i++) {
+		if (!sorted[i]->deleted)
+			sorted[n++] = sorted[i];
+	}
+	*count = n;
+
+	return sorted;
+}
+
+/* Tree of the live keys for the device layouts, whose kernels do not know
+ * deleted nodes. Without deleted nodes that is the tree itself, else a
+ * balanced tree of copies of the live nodes in *copies, which the caller
+ * frees. *count is the number of live nodes. */
+node *build_live_tree(node *root, int *count, node **copies)
+{
+	node **sorted = collect_inorder(root, count);
+	int n = 0;
+
+	*copies = NULL;
+	for (int i = 0; i < *count; i++) {
+		if (!sorted[i]->deleted)
+			sorted[n++] = sorted[i];
+	}
+
+	if (n == *count) {
+		free(sorted);
+		return root;
+	}
+
+	if ((*copies = (node *)malloc((n ? n : 1) * sizeof(node))) == NULL) {
+		printf("Error allocating memory for the live tree.\n");
+		exit(1);
+	}
+	for (int i = 0; i < n; i++)
+		(*copies)[i] = *sorted[i];
+	free(sorted);
+
+	*count = n;
+
+	return link_balanced(*copies, 0, n, NULL);
+}
+
+typedef void (*bfs_emit_fn)(void *tree, long long int id, node *tree_node, int left, int right);
+
+/* Walks the tree in BFS order and hands every node to emit together with
+ * its array index and the indices of its children (-1 if none). The queue
+ * doubles as the slot -> tree node map and is returned in bfs_nodes if
+ * that is not NULL. Returns the number of nodes. */
+static long long int bfs_flatten(node *root, long long int num_nodes, node **bfs_nodes, bfs_emit_fn emit, void *tree)
+{
+	node **tree_queue = bfs_nodes;
+	node *tmp;
+	int left, right;
+
+	if (!root)
+		return 0;
+
+	if (!tree_queue && (tree_queue = (node **)calloc(num_nodes, sizeof(node *))) == NULL) {
+		printf("Error creating tree queue.\n");
+		exit(1);
+	}
+
+	long long int front = 0;
+	long long int rear  = 0;
+
+	tree_queue[rear++] = root;
+
+	while (front != rear) {
+		tmp = tree_queue[front];
+
+		left = right = -1;
+
+		if (tmp->left) {
+			tree_queue[rear] = tmp->left;
+			left = (int)rear++;
+		}
+
+		if (tmp->right) {
+			tree_queue[rear] = tmp->right;
+			right = (int)rear++;
+		}
+
+		emit(tree, front, tmp, left, right);
+		front++;
+	}
+
+	if (tree_queue != bfs_nodes)
+		free(tree_queue);
+
+	return rear;
+}
+
+static void emit_ocl_node(void *tree, long long int id, node *tree_node, int left, int right)
+{
+	ocl_node *ocl_tree = (ocl_node *)tree;
+
+	ocl_tree[id].value = tree_node->value;
+	ocl_tree[id].height = tree_node->height;
+#ifdef BST_SUBTREE_SIZE
+	ocl_tree[id].size = tree_node->size;
+#endif
+	ocl_tree[id].left = left;
+	ocl_tree[id].right = right;
+
+	/* The children come later in BFS order, their parent index is set
+	 * here for the range kernels */
+	if (id == 0)
+		ocl_tree[id].parent = -1;
+	if (left != -1)
+		ocl_tree[left].parent = (int)id;
+	if (right != -1)
+		ocl_tree[right].parent = (int)id;
+}
+
+static void emit_compact_node(void *tree, long long int id, node *tree_node, int left, int right)
+{
+	ocl_compact_node *compact_tree = (ocl_compact_node *)tree;
+
+	compact_tree[id].value = tree_node->value;
+	compact_tree[id].left = left;
+	compact_tree[id].right = right;
+}
+
+static void emit_soa_node(void *tree, long long int id, node *tree_node, int left, int right)
+{
+	ocl_soa_tree *soa_tree = (ocl_soa_tree *)tree;
+
+	soa_tree->keys[id] = tree_node->value;
+	soa_tree->left[id] = left;
+	soa_tree->right[id] = right;
+}
+
+/* Flattens the tree into ocl_tree in BFS order with child indices. If
+ * bfs_nodes is not NULL it receives the tree node of every array slot.
+ * Returns the number of nodes written. */
+long long int convert_tree_to_array(node *root, long long int num_nodes, ocl_node *ocl_tree, node **bfs_nodes, int *root_id)
+{
+
+#if 0
+	/* Method 1 : Uses the fact that the nodes are pre-malloced and they are in contigous memory.
+	 * Will fail in case malloc couldnt return continous memory region.
+	 */
+	int id;
+
+	for (int i = 0; i < num_nodes;	 i++) {
+		ocl_tree[i].value = tree[i].value;
+		ocl_tree[i].height = tree[i].height;
+		ocl_tree[i].right  = (!tree[i].right) ? -1 : (int)(((uintptr_t)tree[i].right - (uintptr_t)tree) / sizeof(node));
+		ocl_tree[i].left   = (!tree[i].left) ? -1 : (int)(((uintptr_t)tree[i].left - (uintptr_t)tree) / sizeof(node));
+		ocl_tree[i].parent = -1;
+	}
+
+	*root_id = (!root) ? -1 : (int)((uintptr_t)root - (uintptr_t)tree);		
+#endif
+
+	long long int count = bfs_flatten(root, num_nodes, bfs_nodes, emit_ocl_node, ocl_tree);
+	*root_id = root ? 0 : -1;
+
+	return count;
+}
+
+/* Same BFS flattening into the 12 byte ocl_compact_node, which only keeps
+ * what the search reads. */
+long long int convert_tree_to_compact_array(node *root, long long int num_nodes, ocl_compact_node *compact_tree, node **bfs_nodes, int *root_id)
+{
+	long long int count = bfs_flatten(root, num_nodes, bfs_nodes, emit_compact_node, compact_tree);
+	*root_id = root ? 0 : -1;
+
+	return count;
+}
+
+/* Same BFS flattening into separate key, left and right arrays. */
+long long int convert_tree_to_soa_array(node *root, long long int num_nodes, ocl_soa_tree *soa_tree, node **bfs_nodes, int *root_id)
+{
+	long long int count = bfs_flatten(root, num_nodes, bfs_nodes, emit_soa_node, soa_tree);
+	*root_id = root ? 0 : -1;
+
+	return count;
+}
+
+ocl_soa_tree *alloc_soa_tree(long long int num_nodes)
+{
+	ocl_soa_tree *soa_tree;
+
+	if ((soa_tree = (ocl_soa_tree *)malloc(sizeof(ocl_soa_tree))) == NULL ||
+		(soa_tree->keys = (int *)bst_aligned_alloc(64, num_nodes * sizeof(int))) == NULL ||
+		(soa_tree->left = (int *)bst_aligned_alloc(64, num_nodes * sizeof(int))) == NULL ||
+		(soa_tree->right = (int *)bst_aligned_alloc(64, num_nodes * sizeof(int))) == NULL) {
+		printf("Error allocating memory for SoA tree.\n");
+		exit(1);
+	}
+
+	return soa_tree;
+}
+
+void free_soa_tree(ocl_soa_tree *soa_tree)
+{
+	if (!soa_tree)
+		return;
+
+	bst_aligned_free(soa_tree->keys);
+	bst_aligned_free(soa_tree->left);
+	bst_aligned_free(soa_tree->right);
+	free(soa_tree);
+}
+
+/* Next node in key order, NULL after the largest. The deleted nodes are
+ * returned as well. */
+node *next_inorder(node *tmp_node)
+{
+	node *parent;
+
+	if (bst_load_ptr(&tmp_node->right)) {
+		tmp_node = bst_load_ptr(&tmp_node->right);
+		while (bst_load_ptr(&tmp_node->left))
+			tmp_node = bst_load_ptr(&tmp_node->left);
+		return tmp_node;
+	}
+
+	parent = bst_load_ptr(&tmp_node->parent);
+	while (parent && tmp_node == bst_load_ptr(&parent->right)) {
+		tmp_node = parent;
+		parent = bst_load_ptr(&parent->parent);
+	}
+
+	return parent;
+}
+
+/* Previous node in key order, NULL before the smallest. */
+node *prev_inorder(node *tmp_node)
+{
+	node *parent;
+
+	if (bst_load_ptr(&tmp_node->left)) {
+		tmp_node = bst_load_ptr(&tmp_node->left);
+		while (bst_load_ptr(&tmp_node->right))
+			tmp_node = bst_load_ptr(&tmp_node->right);
+		return tmp_node;
+	}
+
+	parent = bst_load_ptr(&tmp_node->parent);
+	while (parent && tmp_node == bst_load_ptr(&parent->left)) {
+		tmp_node = parent;
+		parent = bst_load_ptr(&parent->parent);
+	}
+
+	return parent;
+}
+
+/* Called when a search reaches a deleted node with the key. Bulk loads and
+ * rotations leave equal keys on both sides of it, but all of them are in
+ * its subtree, an equal node above it would have ended the search first.
+ * Returns the first live node with the key in key order, NULL if there is
+ * none. */
+node *search_deleted_equal(node *tmp_node, int key)
+{
+	node *best = tmp_node;
+
+	for (node *cur = bst_load_ptr(&tmp_node->left); cur; ) {
+		if (key <= cur->value) {
+			best = cur;
+			cur = bst_load_ptr(&cur->left);
+		}
+		else {
+			cur = bst_load_ptr(&cur->right);
+		}
+	}
+
+	while (best && best->value == key && bst_load_int(&best->deleted))
+		best = next_inorder(best);
+
+	return (best && best->value == key) ? best : NULL;
+}
+
+// Search for an element in the queue. A thread searching while others delete
+// keeps the call inside epoch_enter() / epoch_exit().
+node *search_node(node *root, int key)
+{
+	node *tmp_node = root;
+	
+	while (1) {
+		if (!tmp_node || tmp_node->value == key)
+			break;
+
+		tmp_node = bst_load_ptr((key < tmp_node->value) ? &tmp_node->left : &tmp_node->right);
+	}
+
+	if (tmp_node && bst_load_int(&tmp_node->deleted))
+		tmp_node = search_deleted_equal(tmp_node, key);
+
+	return tmp_node;
+}
+
+typedef struct _search_arg
+{
+	node *root;
+	void *layout;	// Flattened copy of the tree used by the layout engines
+	int *keys;
+	node **found_keys;
+	thread_pool_fn fn;	// Engine search run inside a read epoch
+	long long version;	// Tree version checked by the hot key cache
+	const top_levels *top;	// Replica of the top levels, NULL if not used
+} search_arg;
+
+static void search_range(void *arg, int begin, int end, int worker_id)
+{
+	search_arg *sarg = (search_arg *)arg;
+	int key;
+
+	for (int i = begin; i < end; i++) {
+		key = sarg->keys[i];
+		sarg->found_keys[i] = search_node(top_levels_start(sarg->top, sarg->root, key), key);
+	}
+}
+
+static void interleaved_search_range(void *arg, int begin, int end, int worker_id)
+{
+	search_arg *sarg = (search_arg *)arg;
+
+	interleaved_search(sarg->root, sarg->top, sarg->keys, sarg->found_keys, begin, end, interleave_group);
+}
+
+static void coro_search_range(void *arg, int begin, int end, int worker_id)
+{
+	search_arg *sarg = (search_arg *)arg;
+
+	coro_search(sarg->root, sarg->top, sarg->keys, sarg->found_keys, begin, end, interleave_group);
+}
+
+static void eytzinger_search_range(void *arg, int begin, int end, int worker_id)
+{
+	search_arg *sarg = (search_arg *)arg;
+
+	eytzinger_search_batch((eytzinger_tree *)sarg->layout, sarg->keys, sarg->found_keys, begin, end);
+}
+
+/* BFS array searched by the worker: the replica on the NUMA node of its
+ * cpu, or on the next node when the remote reads are measured */
+static inline bfs_array *worker_bfs(search_arg *sarg, int worker_id)
+{
+	int node_id;
+
+	if (!num_replicas)
+		return (bfs_array *)sarg->layout;
+
+	node_id = numa_cpu_node(thread_pool_worker_cpu(worker_id));
+	if (numa_mode == NUMA_REPLICA_REMOTE)
+		node_id++;
+
+	return bfs_replicas[node_id % num_replicas];
+}
+
+/* Same loop as the ocl_search kernel, run on the cpu. A deleted node has
+ * no entry in nodes, the live nodes with its key are looked up in the
+ * tree as search_node does. */
+static void bfs_array_search_range(void *arg, int begin, int end, int worker_id)
+{
+	search_arg *sarg = (search_arg *)arg;
+	bfs_array *array = worker_bfs(sarg, worker_id);
+	ocl_node *tree = array->tree;
+	int tmp_node_id, key;
+
+	for (int i = begin; i < end; i++) {
+		key = sarg->keys[i];
+		tmp_node_id = array->root_id;
+
+		while (1) {
+			if ((tmp_node_id == -1) || tree[tmp_node_id].value == key)
+				break;
+
+			tmp_node_id = (key < tree[tmp_node_id].value) ? tree[tmp_node_id].left : tree[tmp_node_id].right;
+		}
+
+		if (tmp_node_id == -1)
+			sarg->found_keys[i] = NULL;
+		else if (array->nodes[tmp_node_id])
+			sarg->found_keys[i] = array->nodes[tmp_node_id];
+		else
+			sarg->found_keys[i] = search_node(sarg->root, key);
 	}
+}
 
-	tmp = *root;
+static void compact_array_search_range(void *arg, int begin, int end, int worker_id)
+{
+	search_arg *sarg = (search_arg *)arg;
+	bfs_array *array = worker_bfs(sarg, worker_id);
+	ocl_compact_node *tree = array->compact;
+	int tmp_node_id, key;
 
-	while (1) {
-		if (key < tmp->value) {
-			if (tmp->left == NULL) {
-				tmp->left = new_node;
+	for (int i = begin; i < end; i++) {
+		key = sarg->keys[i];
+		tmp_node_id = array->root_id;
+
+		while (1) {
+			if ((tmp_node_id == -1) || tree[tmp_node_id].value == key)
 				break;
-			}
-			else {
-				tmp = tmp->left;
-			}
+
+			tmp_node_id = (key < tree[tmp_node_id].value) ? tree[tmp_node_id].left : tree[tmp_node_id].right;
 		}
 
-		else {
-			if (tmp->right == NULL) {
-				tmp->right = new_node;
+		if (tmp_node_id == -1)
+			sarg->found_keys[i] = NULL;
+		else if (array->nodes[tmp_node_id])
+			sarg->found_keys[i] = array->nodes[tmp_node_id];
+		else
+			sarg->found_keys[i] = search_node(sarg->root, key);
+	}
+}
+
+static void soa_array_search_range(void *arg, int begin, int end, int worker_id)
+{
+	search_arg *sarg = (search_arg *)arg;
+	bfs_array *array = worker_bfs(sarg, worker_id);
+	const int *tree_keys = array->soa->keys;
+	const int *left = array->soa->left;
+	const int *right = array->soa->right;
+	int tmp_node_id, key;
+
+	for (int i = begin; i < end; i++) {
+		key = sarg->keys[i];
+		tmp_node_id = array->root_id;
+
+		while (1) {
+			if ((tmp_node_id == -1) || tree_keys[tmp_node_id] == key)
 				break;
-			}
-			else {
-				tmp = tmp->right;
-			}
+
+			tmp_node_id = (key < tree_keys[tmp_node_id]) ? left[tmp_node_id] : right[tmp_node_id];
 		}
-	}	
 
-	return 0;
+		if (tmp_node_id == -1)
+			sarg->found_keys[i] = NULL;
+		else if (array->nodes[tmp_node_id])
+			sarg->found_keys[i] = array->nodes[tmp_node_id];
+		else
+			sarg->found_keys[i] = search_node(sarg->root, key);
+	}
 }
 
-static void recursive_insert(node **root, node *new_node)
+static void veb_search_range(void *arg, int begin, int end, int worker_id)
 {
-	int key = new_node->value;
+	search_arg *sarg = (search_arg *)arg;
 
-	if(!(*root)) {
-		*root = new_node;
-		return;
+	veb_search_batch((veb_tree *)sarg->layout, sarg->keys, sarg->found_keys, begin, end);
+}
+
+static void kary_search_range(void *arg, int begin, int end, int worker_id)
+{
+	search_arg *sarg = (search_arg *)arg;
+
+	kary_search_batch((kary_tree *)sarg->layout, sarg->keys, sarg->found_keys, begin, end);
+}
+
+/* Selects the engine used by multithreaded_search. group_size is the number
+ * of traversals a thread keeps in flight in the interleaved engines.
+ * Returns the engine actually selected. */
+int set_search_engine(int engine, int group_size)
+{
+	if (engine < 0 || engine >= SEARCH_ENGINE_COUNT) {
+		printf("Unknown search engine %d, using the pointer tree search.\n", engine);
+		engine = SEARCH_ENGINE_POINTER;
 	}
-	else if(key < (*root)->value) {
-		recursive_insert(&(*root)->left, new_node);
+
+	if (engine == SEARCH_ENGINE_COROUTINE && !coro_search_available()) {
+		printf("Coroutines are not supported by this build, using the interleaved search.\n");
+		engine = SEARCH_ENGINE_INTERLEAVED;
 	}
-	else if(key >= (*root)->value) {
-		recursive_insert(&(*root)->right, new_node);
+
+	/* The layout built for the previous engine is of no use to this one */
+	if (engine != cur_search_engine)
+		release_search_engine();
+
+	cur_search_engine = engine;
+
+	if (group_size > 0)
+		interleave_group = (group_size > MAX_INTERLEAVE_GROUP) ? MAX_INTERLEAVE_GROUP : group_size;
+
+	return cur_search_engine;
+}
+
+const char *search_engine_name(int engine)
+{
+	switch (engine) {
+	case SEARCH_ENGINE_POINTER: return "pointer tree";
+	case SEARCH_ENGINE_INTERLEAVED: return "interleaved (AMAC)";
+	case SEARCH_ENGINE_COROUTINE: return "interleaved (coroutines)";
+	case SEARCH_ENGINE_EYTZINGER: return "eytzinger array";
+	case SEARCH_ENGINE_BFS_ARRAY: return "BFS ocl_node array";
+	case SEARCH_ENGINE_VEB: return "van Emde Boas layout";
+	case SEARCH_ENGINE_KARY: return "SIMD k-ary tree";
+	case SEARCH_ENGINE_COMPACT_ARRAY: return "BFS ocl_compact_node array";
+	case SEARCH_ENGINE_SOA_ARRAY: return "BFS SoA arrays";
+	default: return "unknown";
 	}
+}
 
-	return;
+/* Sets the levels of the tree replicated for the pointer tree engines, 0
+ * turns the replica off. Returns the levels used. */
+int set_top_levels(int levels)
+{
+	if (levels < 0)
+		levels = 0;
+	else if (levels > TOP_LEVELS_MAX)
+		levels = TOP_LEVELS_MAX;
+
+	if (levels != top_levels_wanted)
+		release_search_engine();
+
+	top_levels_wanted = levels;
+
+	return top_levels_wanted;
 }
 
-node * construct_BST(int num_nodes, node *data)
+/* The engines that walk the pointer tree from the root */
+static int uses_top_levels(int engine)
 {
-	node *root = NULL;
+	return engine == SEARCH_ENGINE_POINTER || engine == SEARCH_ENGINE_INTERLEAVED ||
+		engine == SEARCH_ENGINE_COROUTINE;
+}
 
-	/* Inserting nodes into tree */
-	for (int i = 0; i < num_nodes; i++)
-	{
-		iterative_insert(&root, &(data[i]));
-		//root = insert_and_balance(root, &(data[i]));
+/* Returns the flattened layout searched by the engine, NULL for the engines
+ * that walk the pointer tree or when it is not built yet. */
+static void *search_layout(int engine)
+{
+	switch (engine) {
+	case SEARCH_ENGINE_EYTZINGER: return eyt_tree;
+	case SEARCH_ENGINE_BFS_ARRAY: return bfs;
+	case SEARCH_ENGINE_COMPACT_ARRAY: return bfs;
+	case SEARCH_ENGINE_SOA_ARRAY: return bfs;
+	case SEARCH_ENGINE_VEB: return veb;
+	case SEARCH_ENGINE_KARY: return kary;
+	default: return layout_root;
 	}
+}
 
-	return root;
+/* Copies size bytes to memory on the NUMA node. *bound is cleared when the
+ * placement is not enforced. */
+static void *replicate_on_node(const void *src, size_t size, int node_id, int *bound)
+{
+	void *p;
+	int b;
+
+	if (!src)
+		return NULL;
+
+	p = numa_alloc_on_node(size, node_id, &b);
+	memcpy(p, src, size);
+	*bound &= b;
+
+	return p;
 }
 
-void initialize_nodes(node *data, long long int num_nodes)
+/* Copies the searched arrays of bfs to every NUMA node */
+static void build_bfs_replicas(void)
 {
-	int random_num;
-	node *tmp_node;
+	bfs_array *copy;
+	int bound = 1;
 
-	for (int i = 0; i < num_nodes; i++)
-	{
-		tmp_node = &(data[i]);
+	num_replicas = numa_node_count();
 
-		random_num = rand();
-		tmp_node->value = random_num;
-		tmp_node->left = NULL;
-		tmp_node->right = NULL;
-		tmp_node->height = 1;
+	for (int n = 0; n < num_replicas; n++) {
+		if ((copy = (bfs_array *)calloc(1, sizeof(bfs_array))) == NULL) {
+			printf("Error allocating memory for BFS replica.\n");
+			exit(1);
+		}
+
+		copy->nodes = bfs->nodes;
+		copy->root_id = bfs->root_id;
+		copy->count = bfs->count;
+		copy->tree = (ocl_node *)replicate_on_node(bfs->tree, bfs->count * sizeof(ocl_node), n, &bound);
+		copy->compact = (ocl_compact_node *)replicate_on_node(bfs->compact, bfs->count * sizeof(ocl_compact_node), n, &bound);
+		if (bfs->soa) {
+			if ((copy->soa = (ocl_soa_tree *)malloc(sizeof(ocl_soa_tree))) == NULL) {
+				printf("Error allocating memory for BFS replica.\n");
+				exit(1);
+			}
+			copy->soa->keys = (int *)replicate_on_node(bfs->soa->keys, bfs->count * sizeof(int), n, &bound);
+			copy->soa->left = (int *)replicate_on_node(bfs->soa->left, bfs->count * sizeof(int), n, &bound);
+			copy->soa->right = (int *)replicate_on_node(bfs->soa->right, bfs->count * sizeof(int), n, &bound);
+		}
+		bfs_replicas[n] = copy;
 	}
-}
 
+	printf("BFS array replicated on %d NUMA node%s%s\n", num_replicas, (num_replicas > 1) ? "s" : "",
+		bound ? "" : ", pages placed by first touch");
+}
 
-void print_inorder(node * leaf) 
+static void release_bfs_replicas(void)
 {
-	if (leaf) {
-		print_inorder(leaf->left);
-		printf("%d ",leaf->value);
-		print_inorder(leaf->right);
+	bfs_array *copy;
+
+	for (int n = 0; n < num_replicas; n++) {
+		copy = bfs_replicas[n];
+		numa_free(copy->tree, copy->count * sizeof(ocl_node));
+		numa_free(copy->compact, copy->count * sizeof(ocl_compact_node));
+		if (copy->soa) {
+			numa_free(copy->soa->keys, copy->count * sizeof(int));
+			numa_free(copy->soa->left, copy->count * sizeof(int));
+			numa_free(copy->soa->right, copy->count * sizeof(int));
+			free(copy->soa);
+		}
+		free(copy);
+		bfs_replicas[n] = NULL;
 	}
+
+	num_replicas = 0;
 }
 
-static int node_count = 0;
-/* Returns true if the given tree is a BST and its */
-static int isBSTUtil(node* node, int min, int max) 
-{ 
-	if (node==NULL) 
-		return 1;
+/* Sets the NUMA replicas of the BFS array engines, NUMA_REPLICA_*. Switching
+ * between local and remote replicas keeps the replicas built. Returns the
+ * mode set. */
+int set_numa_replicas(int mode)
+{
+	if (mode < NUMA_REPLICA_OFF || mode > NUMA_REPLICA_REMOTE)
+		mode = NUMA_REPLICA_OFF;
 
-	if (node->value < min || node->value > max) 
-		return 0; 
+	if ((mode == NUMA_REPLICA_OFF) != (numa_mode == NUMA_REPLICA_OFF))
+		release_search_engine();
 
-	return isBSTUtil(node->left, min, node->value) && 
-			isBSTUtil(node->right, node->value, max);  
-}
+	numa_mode = mode;
 
-/* Returns true if a binary tree is a binary search tree */
-int isBST(node* node) 
-{ 
-	return isBSTUtil(node, INT_MIN, INT_MAX); 
-} 
+	return numa_mode;
+}
 
-int count_node(node *root)
+/* Number of nodes in the tree, the deleted ones that still route the
+ * searches included. The walk follows the parent links, so it needs
+ * neither a stack nor an array of the nodes. */
+static int count_all_nodes(node *root)
 {
-	int count = -1;
-	if (root)
-		count = 1;
+	node *cur = root, *prev = NULL, *next;
+	node *left, *right;
+	int count = 0;
+
+	while (cur) {
+		left = real_child(cur->left);
+		right = real_child(cur->right);
 
-	if (root->left)
-		count += count_node(root->left);
+		if (prev == cur->parent) {
+			count++;
+			next = left ? left : (right ? right : cur->parent);
+		}
+		else if (prev == left && right) {
+			next = right;
+		}
+		else {
+			next = cur->parent;
+		}
 
-	if (root->right)
-		count += count_node(root->right);
+		prev = cur;
+		cur = next;
+	}
 
 	return count;
 }
 
-// Search for an element in the queue
-node *search_node(node *root, int key)
+/* Builds the flattened layout the selected engine searches. The driver calls
+ * this outside the timed section, multithreaded_search only calls it when
+ * the tree it is given is not the one the layout was built from. */
+void prepare_search_engine(node *root)
 {
-	node *tmp_node = root;
-	
-	while (1) {
-		if (!tmp_node || (tmp_node->value == key))
-			break;
+	node **sorted;
+	int count;
 
-		tmp_node = (key < tmp_node->value) ? tmp_node->left : tmp_node->right;
-	}
+	if (root == layout_root && layout_version == tree_version && search_layout(cur_search_engine) &&
+		(replica || !top_levels_wanted || !uses_top_levels(cur_search_engine)))
+		return;
 
-	return tmp_node;
+	release_search_engine();
+	layout_root = root;
+	layout_version = tree_version;
+
+	if (top_levels_wanted && uses_top_levels(cur_search_engine))
+		replica = top_levels_build(root, top_levels_wanted);
+
+	switch (cur_search_engine) {
+	case SEARCH_ENGINE_EYTZINGER:
+		sorted = collect_live(root, &count);
+		eyt_tree = eytzinger_build(sorted, count);
+		free(sorted);
+		break;
+	case SEARCH_ENGINE_BFS_ARRAY:
+	case SEARCH_ENGINE_COMPACT_ARRAY:
+	case SEARCH_ENGINE_SOA_ARRAY:
+		count = count_all_nodes(root);
+		if ((bfs = (bfs_array *)calloc(1, sizeof(bfs_array))) == NULL ||
+			(bfs->nodes = (node **)malloc(count * sizeof(node *))) == NULL) {
+			printf("Error allocating memory for BFS array.\n");
+			exit(1);
+		}
+		bfs->count = count;
+		if (cur_search_engine == SEARCH_ENGINE_BFS_ARRAY) {
+			if ((bfs->tree = (ocl_node *)malloc(count * sizeof(ocl_node))) == NULL) {
+				printf("Error allocating memory for BFS array.\n");
+				exit(1);
+			}
+			convert_tree_to_array(root, count, bfs->tree, bfs->nodes, &bfs->root_id);
+		}
+		else if (cur_search_engine == SEARCH_ENGINE_COMPACT_ARRAY) {
+			if ((bfs->compact = (ocl_compact_node *)malloc(count * sizeof(ocl_compact_node))) == NULL) {
+				printf("Error allocating memory for BFS array.\n");
+				exit(1);
+			}
+			convert_tree_to_compact_array(root, count, bfs->compact, bfs->nodes, &bfs->root_id);
+		}
+		else {
+			bfs->soa = alloc_soa_tree(count);
+			convert_tree_to_soa_array(root, count, bfs->soa, bfs->nodes, &bfs->root_id);
+		}
+
+		/* Deleted nodes stay in the array to route the searches but
+		 * are not reported as found */
+		for (int i = 0; i < count; i++) {
+			if (bfs->nodes[i]->deleted)
+				bfs->nodes[i] = NULL;
+		}
+
+		if (numa_mode != NUMA_REPLICA_OFF)
+			build_bfs_replicas();
+		break;
+	case SEARCH_ENGINE_VEB:
+		sorted = collect_live(root, &count);
+		veb = veb_build(sorted, count);
+		free(sorted);
+		break;
+	case SEARCH_ENGINE_KARY:
+		sorted = collect_live(root, &count);
+		kary = kary_build(sorted, count);
+		free(sorted);
+		printf("k-ary tree nodes are searched with %s compares.\n", kary_isa_name());
+		break;
+	default:
+		break;
+	}
 }
 
-typedef struct _thread_arg
+void release_search_engine(void)
 {
-	int thread_id;
-	node *root;
-	int *keys;
-	int search_per_keys;
-	node **found_keys;
-} thread_arg;
+	eytzinger_release(eyt_tree);
+	eyt_tree = NULL;
 
-unsigned int __stdcall multithread_search(void *arg)
-{
-	thread_arg *targ = (thread_arg *)arg;
+	veb_release(veb);
+	veb = NULL;
+
+	kary_release(kary);
+	kary = NULL;
 
-	if (!targ || targ->thread_id < 0)
-		_endthread();
+	top_levels_release(replica);
+	replica = NULL;
 
-	int thread_id = targ->thread_id;
-	int init_id = thread_id * targ->search_per_keys;
+	release_bfs_replicas();
 
-	for (int i = init_id; i < init_id + targ->search_per_keys; i++) {
-		targ->found_keys[i] = search_node(targ->root, targ->keys[i]);
+	if (bfs) {
+		free(bfs->tree);
+		free(bfs->compact);
+		free_soa_tree(bfs->soa);
+		free(bfs->nodes);
+		free(bfs);
+		bfs = NULL;
 	}
 
-	_endthreadex(0);
+	layout_root = NULL;
+}
 
-	return 0;
+/* Runs the engine search of a range inside a read epoch, so nodes deleted
+ * meanwhile are not reclaimed under the workers */
+static void epoch_search_range(void *arg, int begin, int end, int worker_id)
+{
+	search_arg *sarg = (search_arg *)arg;
+
+	epoch_enter();
+	sarg->fn(arg, begin, end, worker_id);
+	epoch_exit();
+}
+
+/* Runs the engine search on the keys the hot key cache missed */
+static void cache_miss_search(void *arg, int *keys, node **found, int n, int worker_id)
+{
+	search_arg miss_arg = *(search_arg *)arg;
+
+	miss_arg.keys = keys;
+	miss_arg.found_keys = found;
+	miss_arg.fn(&miss_arg, 0, n, worker_id);
 }
 
+/* Looks the keys up in the worker's hot key cache before the engine search */
+static void cached_search_range(void *arg, int begin, int end, int worker_id)
+{
+	search_arg *sarg = (search_arg *)arg;
+
+	epoch_enter();
+	hot_cache_search(sarg->root, sarg->version, sarg->keys, sarg->found_keys, begin, end,
+		worker_id, cache_miss_search, sarg);
+	epoch_exit();
+}
+
+/* The worker threads are kept alive in the thread pool between calls, so
+ * only the first batch (or a change of num_thread) pays for thread creation.
+ * Keys are handed out in ranges and idle workers steal from busy ones, so a
+ * range full of deep-path keys does not hold up the whole batch. */
 void multithreaded_search(node *root, int *keys, int key_array_size, int num_thread, node **found_keys)
 {
-	HANDLE *hthread = (HANDLE *) malloc(sizeof(HANDLE) * num_thread);
-	if (hthread == NULL) {
-		printf("Error allocating memory for hthread.\n");
-		exit(1);
-	}
+	search_arg sarg;
+	thread_pool_fn fn;
 
-	thread_arg *tmp; 
-	
-	if ((tmp = (thread_arg *)malloc(sizeof(thread_arg) * num_thread)) == NULL) {
-		printf("error allocating memory for thrad_arg.\n");
-		exit(1);
-	}		
-	
-	for (int i = 0; i < num_thread; i++) {
-		tmp[i].thread_id = i;
-		tmp[i].root = root;
-		tmp[i].keys = keys;
-		tmp[i].search_per_keys = (key_array_size / num_thread);
-		tmp[i].found_keys = found_keys;
-		
-		//hthread[i] = (HANDLE) _beginthread(multithread_search, 0, &tmp[i]);
-		hthread[i] = (HANDLE) _beginthreadex(NULL, 0, multithread_search, &tmp[i], 0, NULL);
-		if (hthread[i] == 0) {
-			printf("Error creating thread. Error is: %s\n", strerror(errno));
-			exit(1);
-		}
-	}
+	prepare_search_engine(root);
 
-	WaitForMultipleObjects(num_thread, hthread, TRUE, INFINITE);
+	sarg.root = root;
+	sarg.layout = search_layout(cur_search_engine);
+	sarg.keys = keys;
+	sarg.found_keys = found_keys;
 
-	for (int i = 0; i < num_thread; i++)
-		CloseHandle(hthread[i]);
+	switch (cur_search_engine) {
+	case SEARCH_ENGINE_INTERLEAVED:
+		fn = interleaved_search_range;
+		break;
+	case SEARCH_ENGINE_COROUTINE:
+		fn = coro_search_range;
+		break;
+	case SEARCH_ENGINE_EYTZINGER:
+		fn = eytzinger_search_range;
+		break;
+	case SEARCH_ENGINE_BFS_ARRAY:
+		fn = bfs_array_search_range;
+		break;
+	case SEARCH_ENGINE_COMPACT_ARRAY:
+		fn = compact_array_search_range;
+		break;
+	case SEARCH_ENGINE_SOA_ARRAY:
+		fn = soa_array_search_range;
+		break;
+	case SEARCH_ENGINE_VEB:
+		fn = veb_search_range;
+		break;
+	case SEARCH_ENGINE_KARY:
+		fn = kary_search_range;
+		break;
+	default:
+		fn = search_range;
+		break;
+	}
 
-	if (hthread)
-		free(hthread);
+	sarg.fn = fn;
+	sarg.version = tree_version;
+	sarg.top = replica;
 
-	if (tmp)
-		free(tmp);
+	thread_pool_init(num_thread);
+	thread_pool_run(hot_cache_entries() ? cached_search_range : epoch_search_range, &sarg, key_array_size);
 }
 
 
+/* Tree nodes read per search with and without the top level replica, on
+ * the keys of the last batch */
+void print_top_levels_stats(node *root, int *keys, int num_keys)
+{
+	top_levels_print_stats(replica, root, keys, num_keys);
+}
+
 // A utility function to get maximum of two integers
 int max_val(int a, int b)
 {
@@ -274,6 +1629,33 @@ int height(node *t)
      return t->height;
 }
 
+// Live keys in the subtree of t
+int subtree_size(node *t)
+{
+#ifdef BST_SUBTREE_SIZE
+    if (t == NULL)
+        return 0;
+    return t->size;
+#else
+    return 0;
+#endif
+}
+
+// Recompute the size of t from its children
+static void update_size(node *t)
+{
+    set_size(t, subtree_size(t->left) + subtree_size(t->right) + !t->deleted);
+}
+
+// Add delta to the size of t and of all its ancestors
+static void add_size_upward(node *t, int delta)
+{
+#ifdef BST_SUBTREE_SIZE
+    for (; t; t = t->parent)
+        t->size += delta;
+#endif
+}
+
 // Get Balance factor of node N
 int getBalance(node *N)
 {
@@ -291,10 +1673,18 @@ node *rightRotate(node *y)
     // Perform rotation
     x->right = y;
     y->left = T2;
+
+    // Update parents, the caller links x into y's old parent
+    x->parent = y->parent;
+    y->parent = x;
+    if (T2)
+        T2->parent = y;
  
-    // Update heights
+    // Update heights and sizes
     y->height = max_val(height(y->left), height(y->right))+1;
     x->height = max_val(height(x->left), height(x->right))+1;
+    update_size(y);
+    update_size(x);
  
     // Return new root
     return x;
@@ -309,10 +1699,18 @@ node *leftRotate(node *x)
     // Perform rotation
     y->left = x;
     x->right = T2;
+
+    // Update parents, the caller links y into x's old parent
+    y->parent = x->parent;
+    x->parent = y;
+    if (T2)
+        T2->parent = x;
  
-    //  Update heights
+    //  Update heights and sizes
     x->height = max_val(height(x->left), height(x->right))+1;
     y->height = max_val(height(y->left), height(y->right))+1;
+    update_size(x);
+    update_size(y);
  
     // Return new root
     return y;
@@ -333,20 +1731,24 @@ node * insert_and_balance(node *leaf, node *new_node)
 
     if( leaf == NULL )
     {
+        set_size(new_node, 1);
         return(new_node);
     }
 
     if(key < leaf->value)
     {
         leaf->left = insert_and_balance(leaf->left, new_node);
+        leaf->left->parent = leaf;
     }
     else
     {
         leaf->right = insert_and_balance(leaf->right, new_node);
+        leaf->right->parent = leaf;
     }
 
-    /* Update height of this ancestor node */
+    /* Update height and size of this ancestor node */
     leaf->height = max_val(height(leaf->left), height(leaf->right)) + 1;
+    update_size(leaf);
 
     ////////////////////////////////////////////////
     // Balance the tree in case it is not balanced
@@ -381,3 +1783,236 @@ node * insert_and_balance(node *leaf, node *new_node)
     /* return the (unchanged) node pointer */
     return leaf;
 }
+
+// Replace the child old_child of parent by new_child, parent NULL is the root
+static void replace_child(node **root, node *parent, node *old_child, node *new_child)
+{
+    if (parent == NULL)
+        *root = new_child;
+    else if (parent->left == old_child)
+        parent->left = new_child;
+    else
+        parent->right = new_child;
+}
+
+// Walk from leaf up to the root through the parent links, updating heights
+// and rotating the first unbalanced node. After an insert one (single or
+// double) rotation restores the height the subtree had, so the rebalancing
+// stops there, or as soon as a height does not change. The nodes above only
+// count the new leaf in their size.
+static void rebalance_upward(node **root, node *leaf)
+{
+    node *tmp_node = leaf;
+    node *parent, *sub;
+    int old_height, balance;
+
+    while (tmp_node)
+    {
+        parent = tmp_node->parent;
+        old_height = tmp_node->height;
+        tmp_node->height = max_val(height(tmp_node->left), height(tmp_node->right)) + 1;
+        update_size(tmp_node);
+        balance = getBalance(tmp_node);
+
+        if (balance > 1)
+        {
+            // Left Right Case
+            if (getBalance(tmp_node->left) < 0)
+                tmp_node->left = leftRotate(tmp_node->left);
+            // Left Left Case
+            sub = rightRotate(tmp_node);
+            replace_child(root, parent, tmp_node, sub);
+            add_size_upward(parent, 1);
+            return;
+        }
+
+        if (balance < -1)
+        {
+            // Right Left Case
+            if (getBalance(tmp_node->right) > 0)
+                tmp_node->right = rightRotate(tmp_node->right);
+            // Right Right Case
+            sub = leftRotate(tmp_node);
+            replace_child(root, parent, tmp_node, sub);
+            add_size_upward(parent, 1);
+            return;
+        }
+
+        if (tmp_node != leaf && tmp_node->height == old_height)
+        {
+            add_size_upward(parent, 1);
+            return;
+        }
+
+        tmp_node = parent;
+    }
+}
+
+// Link new_node below start, the subtree the key is known to belong in
+static void link_leaf(node **root, node *start, node *new_node)
+{
+    node *tmp_node = start;
+    int key = new_node->value;
+
+    new_node->left = NULL;
+    new_node->right = NULL;
+    new_node->height = 1;
+    set_size(new_node, 1);
+
+    if (tmp_node == NULL)
+    {
+        new_node->parent = NULL;
+        *root = new_node;
+        return;
+    }
+
+    while (1)
+    {
+        node **slot = (key < tmp_node->value) ? &tmp_node->left : &tmp_node->right;
+
+        if (*slot == NULL)
+        {
+            *slot = new_node;
+            new_node->parent = tmp_node;
+            return;
+        }
+        tmp_node = *slot;
+    }
+}
+
+// Non recursive version of insert_and_balance. The insert walks down, links
+// the node and rebalances on the way back up through the parent links, so
+// the call stack does not grow with the tree. Returns the new root.
+node * avl_insert(node *root, node *new_node)
+{
+    link_leaf(&root, root, new_node);
+    rebalance_upward(&root, new_node);
+    tree_version++;
+
+    return root;
+}
+
+// Insert a batch of nodes into the AVL tree in one pass in key order. Each
+// insert starts from the node inserted before it (a finger): the walk goes
+// up only until the key falls inside the subtree below, then down from
+// there. Neighbouring keys land close to each other, so most inserts skip
+// the walk from the root. The nodes are not moved, only visited in sorted
+// order. Returns the new root.
+node * avl_insert_batch(node *root, node *new_nodes, int num_nodes)
+{
+    node *finger = NULL;
+    node *start, *new_node;
+    int *keys, *perm;
+    int key;
+
+    if (num_nodes <= 0)
+        return root;
+
+    if ((keys = (int *)malloc(num_nodes * sizeof(int))) == NULL ||
+        (perm = (int *)malloc(num_nodes * sizeof(int))) == NULL)
+    {
+        printf("Error allocating memory for batch insert.\n");
+        exit(1);
+    }
+
+    for (int i = 0; i < num_nodes; i++)
+        keys[i] = new_nodes[i].value;
+    radix_sort(keys, perm, num_nodes);
+
+    for (int i = 0; i < num_nodes; i++)
+    {
+        new_node = &new_nodes[perm[i]];
+        key = new_node->value;
+
+        // Climb while the key goes right of the parent or we are its right
+        // child, the first left child with key < parent value holds the key
+        start = finger ? finger : root;
+        while (start && start->parent &&
+               (start == start->parent->right || key >= start->parent->value))
+            start = start->parent;
+
+        link_leaf(&root, start, new_node);
+        rebalance_upward(&root, new_node);
+        finger = new_node;
+    }
+
+    free(keys);
+    free(perm);
+    tree_version++;
+
+    return root;
+}
+
+/* Unlinks the deleted node if it has at most one child, then goes on with
+ * its parent, which may be a deleted node that was kept only to route to
+ * this one. Called with write_lock held. */
+static void unlink_deleted(node **root, node *tmp_node)
+{
+	node *parent, *child, *left, *right;
+
+	while (tmp_node && tmp_node->deleted) {
+		/* Close the empty slots to lockfree_insert. An insert that wins
+		 * the race leaves a child the node has to keep. */
+		left = bst_cas_ptr(&tmp_node->left, NULL, &dead_leaf);
+		right = bst_cas_ptr(&tmp_node->right, NULL, &dead_leaf);
+
+		if (left && right)
+			return;
+
+		child = left ? left : right;
+
+		/* Readers on the node go on through its unchanged children,
+		 * its memory is reclaimed only when they are all gone */
+		parent = tmp_node->parent;
+		if (child)
+			bst_store_ptr(&child->parent, parent);
+		if (parent == NULL)
+			bst_store_ptr(root, child);
+		else if (bst_load_ptr(&parent->left) == tmp_node)
+			bst_store_ptr(&parent->left, child);
+		else
+			bst_store_ptr(&parent->right, child);
+
+		epoch_retire(tmp_node);
+		tmp_node = parent;
+	}
+}
+
+/* Deletes one node with the key. The node is marked deleted first, which
+ * hides it from the searches at once. A node with at most one child is then
+ * unlinked by a single pointer store, a node with two children stays in the
+ * tree to route the searches until one of its subtrees is gone. Concurrent
+ * searches and lockfree_insert calls are safe, both walk the tree inside
+ * a read epoch, deletes are serialized.
+ * Returns 1 if a node was deleted, 0 if the key is not in the tree. */
+int delete_node(node **root, int key)
+{
+	node *tmp_node;
+
+	std::lock_guard<std::mutex> guard(write_lock);
+
+	tmp_node = search_node(*root, key);
+	if (!tmp_node)
+		return 0;
+
+	bst_store_int(&tmp_node->deleted, 1);
+#ifdef BST_SUBTREE_SIZE
+	for (node *tmp = tmp_node; tmp; tmp = tmp->parent)
+		bst_atomic_add(&tmp->size, -1);
+#endif
+	unlink_deleted(root, tmp_node);
+	tree_version++;
+
+	return 1;
+}
+
+/* Deletes a batch of keys, returns the number of nodes deleted. */
+int delete_keys(node **root, int *keys, int num_keys)
+{
+	int deleted = 0;
+
+	for (int i = 0; i < num_keys; i++)
+		deleted += delete_node(root, keys[i]);
+
+	return deleted;
+}
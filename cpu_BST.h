@@ -1,15 +1,176 @@
 #ifndef CPU_BST_H_
 #define CPU_BST_H_
 
+#include <stdlib.h>
+#include <stdint.h>
 #include "hsa_BST_search.h"
+#include "ocl_BST_search.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <malloc.h>
+#include <xmmintrin.h>
+#define BST_PREFETCH(addr) _mm_prefetch((const char *)(addr), _MM_HINT_T0)
+
+static inline int bst_ffsll(unsigned long long x)
+{
+	unsigned long idx;
+	return _BitScanForward64(&idx, x) ? (int)idx + 1 : 0;
+}
+
+static inline void *bst_aligned_alloc(size_t align, size_t size)
+{
+	return _aligned_malloc(size, align);
+}
+
+static inline void bst_aligned_free(void *p)
+{
+	_aligned_free(p);
+}
+
+/* Atomically replaces *slot with desired if it holds expected. Returns the
+ * value *slot held, equal to expected on success. */
+static inline node *bst_cas_ptr(node **slot, node *expected, node *desired)
+{
+	return (node *)_InterlockedCompareExchangePointer((void * volatile *)slot, desired, expected);
+}
+
+static inline void bst_atomic_add(int *value, int delta)
+{
+	_InterlockedExchangeAdd((volatile long *)value, delta);
+}
+
+/* Acquire loads and release stores of the links and flags that change
+ * while other threads search the tree. Volatile accesses are both on x86
+ * with /volatile:ms, the default. */
+static inline node *bst_load_ptr(node **slot)
+{
+	return *(node * volatile *)slot;
+}
+
+static inline void bst_store_ptr(node **slot, node *value)
+{
+	*(node * volatile *)slot = value;
+}
+
+static inline int bst_load_int(int *value)
+{
+	return *(volatile int *)value;
+}
+
+static inline void bst_store_int(int *value, int v)
+{
+	*(volatile int *)value = v;
+}
+#else
+#define BST_PREFETCH(addr) __builtin_prefetch((addr), 0, 3)
+
+static inline int bst_ffsll(unsigned long long x)
+{
+	return __builtin_ffsll((long long)x);
+}
+
+static inline void *bst_aligned_alloc(size_t align, size_t size)
+{
+	void *p;
+	return posix_memalign(&p, align, size) ? NULL : p;
+}
+
+static inline void bst_aligned_free(void *p)
+{
+	free(p);
+}
+
+static inline node *bst_cas_ptr(node **slot, node *expected, node *desired)
+{
+	__atomic_compare_exchange_n(slot, &expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+	return expected;
+}
+
+static inline void bst_atomic_add(int *value, int delta)
+{
+	__atomic_fetch_add(value, delta, __ATOMIC_RELAXED);
+}
+
+/* Acquire loads and release stores of the links and flags that change
+ * while other threads search the tree */
+static inline node *bst_load_ptr(node **slot)
+{
+	return __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+}
+
+static inline void bst_store_ptr(node **slot, node *value)
+{
+	__atomic_store_n(slot, value, __ATOMIC_RELEASE);
+}
+
+static inline int bst_load_int(int *value)
+{
+	return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+}
+
+static inline void bst_store_int(int *value, int v)
+{
+	__atomic_store_n(value, v, __ATOMIC_RELEASE);
+}
+#endif
+
+/* Structure of arrays form of the BFS array: the keys are contiguous so
+ * SIMD code and vector loads read keys only. */
+typedef struct _ocl_soa_tree
+{
+	int *keys;
+	int *left;	// index to the left node, -1 if none
+	int *right;	// index to the right node, -1 if none
+} ocl_soa_tree;
+
+/* Batch search engines used by multithreaded_search */
+typedef enum _search_engine
+{
+	SEARCH_ENGINE_POINTER = 0,	// search_node on the pointer tree
+	SEARCH_ENGINE_INTERLEAVED,	// interleaved traversals with prefetch (AMAC)
+	SEARCH_ENGINE_COROUTINE,	// interleaved traversals as C++20 coroutines
+	SEARCH_ENGINE_EYTZINGER,	// branchless search on the Eytzinger array
+	SEARCH_ENGINE_BFS_ARRAY,	// the BFS ocl_node array of convert_tree_to_array
+	SEARCH_ENGINE_VEB,			// van Emde Boas layout
+	SEARCH_ENGINE_KARY,			// SIMD k-ary tree, one cache line per node
+	SEARCH_ENGINE_COMPACT_ARRAY,	// BFS array of 12 byte ocl_compact_node
+	SEARCH_ENGINE_SOA_ARRAY,	// BFS array as separate key/child arrays
+	SEARCH_ENGINE_COUNT
+} search_engine;
 
 node * construct_BST(int num_nodes, node *data);
-void initialize_nodes(node *data, long long int num_nodes);
+node * bulk_load_BST(int num_nodes, node *data);
+node *lockfree_insert(node **root, node *new_node);
+void multithreaded_insert(node **root, node *new_nodes, int num_nodes, int num_thread);
+int delete_node(node **root, int key);
+int delete_keys(node **root, int *keys, int num_keys);
+void initialize_nodes(node *data, long long int num_nodes, uint64_t seed);
 node * search_node(node *data, int key);
+node *search_deleted_equal(node *tmp_node, int key);
+node *next_inorder(node *tmp_node);
+node *prev_inorder(node *tmp_node);
 void print_inorder(node * leaf);
 int isBST(node* root);
 int count_node(node *root);
+node **collect_inorder(node *root, int *count);
+node **collect_live(node *root, int *count);
+node *build_live_tree(node *root, int *count, node **copies);
+long long int convert_tree_to_array(node *root, long long int num_nodes, ocl_node *ocl_tree, node **bfs_nodes, int *root_id);
+long long int convert_tree_to_compact_array(node *root, long long int num_nodes, ocl_compact_node *compact_tree, node **bfs_nodes, int *root_id);
+long long int convert_tree_to_soa_array(node *root, long long int num_nodes, ocl_soa_tree *soa_tree, node **bfs_nodes, int *root_id);
+ocl_soa_tree *alloc_soa_tree(long long int num_nodes);
+void free_soa_tree(ocl_soa_tree *soa_tree);
 void multithreaded_search(node *root, int *keys, int key_array_size, int num_thread, node **found_keys);
 node * insert_and_balance(node *leaf, node *new_node);
+node * avl_insert(node *root, node *new_node);
+node * avl_insert_batch(node *root, node *new_nodes, int num_nodes);
+int set_search_engine(int engine, int group_size);
+const char *search_engine_name(int engine);
+void prepare_search_engine(node *root);
+void release_search_engine(void);
+int set_top_levels(int levels);
+int set_numa_replicas(int mode);
+void print_top_levels_stats(node *root, int *keys, int num_keys);
 
 #endif
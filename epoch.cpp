@@ -0,0 +1,236 @@
+/*******************************************************************************
+Copyright 2013 Advanced Micro Devices, Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1 Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+2 Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+/**
+********************************************************************************
+* @file <epoch.cpp>
+*
+* @brief This file contains the epoch based reclamation of unlinked nodes.
+* A reader announces the global epoch while it walks the tree. A node
+* unlinked by a writer is retired in the current epoch and the epoch only
+* moves on once every active reader has seen it, so two epochs later no
+* reader can still hold a pointer to the node and it is reclaimed. A
+* reclaimed node goes on a free list the inserts take their nodes from,
+* its memory still belongs to the node pool of the caller.
+*
+********************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include "cpu_BST.h"
+#include "epoch.h"
+
+#define EPOCH_IDLE 0ULL
+
+/* Epoch announced by a reader, EPOCH_IDLE outside of a read section. A slot
+ * is owned by one thread at a time. Padded so that readers do not share
+ * cache lines. */
+typedef struct _epoch_slot
+{
+	std::atomic<unsigned long long> epoch;
+	std::atomic<int> used;
+	char pad[64 - sizeof(std::atomic<unsigned long long>) - sizeof(std::atomic<int>)];
+} epoch_slot;
+
+/* Nodes retired in one epoch */
+typedef struct _limbo_list
+{
+	node **nodes;
+	int count;
+	int size;
+} limbo_list;
+
+static std::atomic<unsigned long long> global_epoch(1);
+static epoch_slot slots[EPOCH_MAX_THREADS];
+static std::atomic<int> num_slots(0);	// Slots ever used, scanned by try_advance
+
+/* Slot of the thread, handed back when the thread exits. Pool workers are
+ * recreated whenever the thread count changes, so the slots are reused
+ * instead of running out. */
+struct slot_owner
+{
+	int slot;
+	int depth;
+
+	~slot_owner()
+	{
+		if (slot < 0)
+			return;
+
+		slots[slot].epoch.store(EPOCH_IDLE, std::memory_order_release);
+		slots[slot].used.store(0, std::memory_order_release);
+	}
+};
+
+static thread_local slot_owner me = { -1, 0 };
+
+/* Claims the first free slot */
+static int claim_slot(void)
+{
+	int expected, seen;
+
+	for (int i = 0; i < EPOCH_MAX_THREADS; i++) {
+		expected = 0;
+		if (slots[i].used.load(std::memory_order_relaxed) ||
+			!slots[i].used.compare_exchange_strong(expected, 1, std::memory_order_acq_rel))
+			continue;
+
+		seen = num_slots.load();
+		while (seen <= i && !num_slots.compare_exchange_weak(seen, i + 1))
+			;
+		return i;
+	}
+
+	printf("Error: more than %d threads reading the tree.\n", EPOCH_MAX_THREADS);
+	exit(1);
+}
+
+/* Only the writer holding the tree write lock retires nodes, so the limbo
+ * lists need no locking of their own. */
+static limbo_list limbo[3];
+static long long num_retired = 0;
+static long long num_reclaimed = 0;
+
+/* Reclaimed nodes linked through left. Pushed by the writer, popped by the
+ * inserts from any thread. */
+static std::atomic<node *> free_nodes(NULL);
+static std::atomic<long long> num_reused(0);
+
+/* Enters a read section. Sections nest, only the outermost one announces
+ * the epoch. */
+void epoch_enter(void)
+{
+	if (me.depth++)
+		return;
+
+	if (me.slot < 0)
+		me.slot = claim_slot();
+
+	slots[me.slot].epoch.store(global_epoch.load(std::memory_order_relaxed), std::memory_order_seq_cst);
+}
+
+void epoch_exit(void)
+{
+	if (--me.depth)
+		return;
+
+	slots[me.slot].epoch.store(EPOCH_IDLE, std::memory_order_release);
+}
+
+/* Moves the global epoch on if every reader in a read section has seen the
+ * current one. The nodes retired two epochs back are reclaimed. */
+static void try_advance(void)
+{
+	unsigned long long cur = global_epoch.load(std::memory_order_seq_cst);
+	unsigned long long e;
+	int n = num_slots.load(std::memory_order_acquire);
+	limbo_list *list;
+	node *head;
+
+	if (n > EPOCH_MAX_THREADS)
+		n = EPOCH_MAX_THREADS;
+
+	for (int i = 0; i < n; i++) {
+		e = slots[i].epoch.load(std::memory_order_seq_cst);
+		if (e != EPOCH_IDLE && e != cur)
+			return;
+	}
+
+	global_epoch.store(cur + 1, std::memory_order_seq_cst);
+
+	/* The list retired two epochs back goes on the free list at once */
+	list = &limbo[(cur + 1) % 3];
+	if (!list->count)
+		return;
+
+	for (int i = 0; i + 1 < list->count; i++)
+		bst_store_ptr(&list->nodes[i]->left, list->nodes[i + 1]);
+	head = free_nodes.load(std::memory_order_acquire);
+	do {
+		bst_store_ptr(&list->nodes[list->count - 1]->left, head);
+	} while (!free_nodes.compare_exchange_weak(head, list->nodes[0], std::memory_order_acq_rel, std::memory_order_acquire));
+
+	num_reclaimed += list->count;
+	list->count = 0;
+}
+
+/* Retires a node the caller has unlinked from the tree. Its memory stays
+ * untouched until no reader can reach it any more. */
+void epoch_retire(node *tree_node)
+{
+	limbo_list *list = &limbo[global_epoch.load(std::memory_order_seq_cst) % 3];
+	node **tmp;
+
+	if (list->count == list->size) {
+		list->size = list->size ? 2 * list->size : 1024;
+		if ((tmp = (node **)realloc(list->nodes, list->size * sizeof(node *))) == NULL) {
+			printf("Error allocating memory for retired nodes.\n");
+			exit(1);
+		}
+		list->nodes = tmp;
+	}
+
+	list->nodes[list->count++] = tree_node;
+	num_retired++;
+
+	try_advance();
+}
+
+/* Takes a reclaimed node off the free list, NULL if there is none. Called
+ * inside a read section: a node another thread pops meanwhile cannot be
+ * retired and reclaimed again before the section ends, so the pop does not
+ * see it back at the head with another next node. */
+node *epoch_reuse_node(void)
+{
+	node *head = free_nodes.load(std::memory_order_acquire);
+
+	while (head && !free_nodes.compare_exchange_weak(head, bst_load_ptr(&head->left),
+		std::memory_order_acq_rel, std::memory_order_acquire))
+		;
+
+	if (head)
+		num_reused.fetch_add(1, std::memory_order_relaxed);
+
+	return head;
+}
+
+void epoch_release(void)
+{
+	for (int i = 0; i < 3; i++) {
+		free(limbo[i].nodes);
+		limbo[i].nodes = NULL;
+		limbo[i].count = 0;
+		limbo[i].size = 0;
+	}
+	free_nodes.store(NULL);
+}
+
+void epoch_print_stats(void)
+{
+	printf("Epoch %llu: %lld nodes retired, %lld reclaimed, %lld reused\n",
+		global_epoch.load(), num_retired, num_reclaimed, num_reused.load());
+}
@@ -0,0 +1,16 @@
+#ifndef EPOCH_H_
+#define EPOCH_H_
+
+#include "hsa_BST_search.h"
+
+/* Largest number of threads that can read the tree under an epoch. */
+#define EPOCH_MAX_THREADS 256
+
+void epoch_enter(void);
+void epoch_exit(void);
+void epoch_retire(node *tree_node);
+node *epoch_reuse_node(void);
+void epoch_release(void);
+void epoch_print_stats(void);
+
+#endif
@@ -0,0 +1,127 @@
+/*******************************************************************************
+Copyright 2013 Advanced Micro Devices, Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1 Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+2 Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+/**
+********************************************************************************
+* @file <eytzinger.cpp>
+*
+* @brief This file contains the Eytzinger (implicit BFS) layout of the BST.
+* The sorted keys are laid out so that the children of slot k are at 2k and
+* 2k + 1. There are no child indices to load, the descent is branchless and
+* the lines of the next four levels are prefetched while comparing.
+*
+********************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include "cpu_BST.h"
+#include "eytzinger.h"
+
+/* In-order walk of the implicit tree, filling slot k with the next key.
+ * The recursion depth is the height of the implicit tree (log2 n). */
+static void fill_slots(eytzinger_tree *tree, node **sorted, int *next, long long k)
+{
+	if (k > tree->num_nodes)
+		return;
+
+	fill_slots(tree, sorted, next, 2 * k);
+	tree->nodes[k] = sorted[*next];
+	tree->keys[k] = sorted[*next]->value;
+	(*next)++;
+	fill_slots(tree, sorted, next, 2 * k + 1);
+}
+
+eytzinger_tree *eytzinger_build(node **sorted, int num_nodes)
+{
+	eytzinger_tree *tree;
+	int next = 0;
+
+	if ((tree = (eytzinger_tree *)malloc(sizeof(eytzinger_tree))) == NULL) {
+		printf("Error allocating memory for eytzinger tree.\n");
+		exit(1);
+	}
+
+	tree->num_nodes = num_nodes;
+
+	if ((tree->keys = (int *)bst_aligned_alloc(64, (num_nodes + 1) * sizeof(int))) == NULL) {
+		printf("Error allocating memory for eytzinger keys.\n");
+		exit(1);
+	}
+
+	if ((tree->nodes = (node **)malloc((num_nodes + 1) * sizeof(node *))) == NULL) {
+		printf("Error allocating memory for eytzinger nodes.\n");
+		exit(1);
+	}
+
+	tree->keys[0] = INT_MIN;
+	tree->nodes[0] = NULL;
+	fill_slots(tree, sorted, &next, 1);
+
+	return tree;
+}
+
+void eytzinger_release(eytzinger_tree *tree)
+{
+	if (!tree)
+		return;
+
+	bst_aligned_free(tree->keys);
+	free(tree->nodes);
+	free(tree);
+}
+
+/* Returns the slot of the first key >= key, 0 if there is none. The loop
+ * has no data dependent branch: the comparison result becomes the last
+ * bit of the next slot. The right turns taken after the answer are undone
+ * by shifting out the trailing ones and the final left turn. */
+int eytzinger_lower_bound(const int *keys, int num_nodes, int key)
+{
+	unsigned long long k = 1;
+
+	while (k <= (unsigned long long)num_nodes) {
+		BST_PREFETCH(keys + 16 * k);
+		k = 2 * k + (keys[k] < key);
+	}
+
+	k >>= bst_ffsll(~k);
+
+	return (int)k;
+}
+
+node *eytzinger_search(eytzinger_tree *tree, int key)
+{
+	int k = eytzinger_lower_bound(tree->keys, tree->num_nodes, key);
+
+	return (k && tree->keys[k] == key) ? tree->nodes[k] : NULL;
+}
+
+void eytzinger_search_batch(eytzinger_tree *tree, int *keys, node **found_keys, int begin, int end)
+{
+	for (int i = begin; i < end; i++) {
+		found_keys[i] = eytzinger_search(tree, keys[i]);
+	}
+}
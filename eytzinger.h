@@ -0,0 +1,25 @@
+#ifndef EYTZINGER_H_
+#define EYTZINGER_H_
+
+#include "hsa_BST_search.h"
+
+/* Implicit BFS (Eytzinger) layout of the sorted keys. The array is 1 based:
+ * the root is keys[1] and the children of keys[k] are keys[2k] and
+ * keys[2k + 1] (2i + 1 and 2i + 2 when counted from the root at 0).
+ * keys[0] is padding that keeps the 16 descendants four levels below any
+ * node in one 64 byte line. nodes[k] is the tree node holding keys[k] and
+ * is only read after a match. */
+typedef struct _eytzinger_tree
+{
+	int *keys;
+	node **nodes;
+	int num_nodes;
+} eytzinger_tree;
+
+eytzinger_tree *eytzinger_build(node **sorted, int num_nodes);
+void eytzinger_release(eytzinger_tree *tree);
+int eytzinger_lower_bound(const int *keys, int num_nodes, int key);
+node *eytzinger_search(eytzinger_tree *tree, int key);
+void eytzinger_search_batch(eytzinger_tree *tree, int *keys, node **found_keys, int begin, int end);
+
+#endif
@@ -0,0 +1,290 @@
+/*******************************************************************************
+Copyright 2013 Advanced Micro Devices, Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1 Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+2 Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+/**
+********************************************************************************
+* @file <hot_cache.cpp>
+*
+* @brief This file contains the hot key cache in front of the cpu search.
+* Every search thread owns a set associative key -> node cache, so a
+* skewed key stream resolves its hot keys without walking from the root
+* and the threads never share a line of it. The misses of a range are
+* gathered and searched by the selected engine in one batch, then put in
+* the cache. A cache is flushed when it sees a new root or tree version,
+* which every insert and delete bumps.
+*
+********************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cpu_BST.h"
+#include "hot_cache.h"
+
+/* One set: keys[w] maps to nodes[w] for the ways set in valid. A NULL node
+ * records a key that is not in the tree. */
+typedef struct _hot_set
+{
+	int keys[HOT_CACHE_WAYS];
+	unsigned int valid;
+	unsigned int victim;	// Way replaced next when the set is full
+	node *nodes[HOT_CACHE_WAYS];
+	char pad[64 - HOT_CACHE_WAYS * (sizeof(int) + sizeof(node *)) - 2 * sizeof(unsigned int)];
+} hot_set;
+
+/* Cache and miss buffers of one worker, padded so that the counters of two
+ * workers do not share a cache line */
+typedef struct _hot_worker
+{
+	hot_set *sets;
+	int num_sets;
+	node *root;	// Tree and version the entries were filled from
+	long long version;
+	int *miss_keys;
+	int *miss_pos;
+	node **miss_found;
+	int miss_size;
+	long long hits;
+	long long misses;
+	long long stale;
+	long long flushes;
+	char pad[64];
+} hot_worker;
+
+static hot_worker workers[HOT_CACHE_MAX_THREADS];
+static int cache_sets = 0;
+static int num_entries_used = 0;
+
+/* Sets the entries of every thread's cache, 0 turns the cache off. The
+ * size is rounded up to a power of two number of sets. Returns the number
+ * of entries per thread. */
+int hot_cache_configure(int num_entries)
+{
+	int sets = 1;
+
+	if (num_entries <= 0) {
+		cache_sets = 0;
+		num_entries_used = 0;
+		return 0;
+	}
+
+	while (sets * HOT_CACHE_WAYS < num_entries)
+		sets <<= 1;
+
+	cache_sets = sets;
+	num_entries_used = sets * HOT_CACHE_WAYS;
+
+	return num_entries_used;
+}
+
+int hot_cache_entries(void)
+{
+	return num_entries_used;
+}
+
+static inline hot_set *set_of(hot_worker *w, int key)
+{
+	unsigned int h = (unsigned int)key * 0x9E3779B1u;
+
+	return &w->sets[(h ^ (h >> 16)) & (w->num_sets - 1)];
+}
+
+/* Empties the cache, allocating it first if the configured size changed */
+static void flush_worker(hot_worker *w, node *root, long long version)
+{
+	if (w->num_sets != cache_sets) {
+		bst_aligned_free(w->sets);
+		w->num_sets = cache_sets;
+		if ((w->sets = (hot_set *)bst_aligned_alloc(64, cache_sets * sizeof(hot_set))) == NULL) {
+			printf("Error allocating memory for the hot key cache.\n");
+			exit(1);
+		}
+	}
+
+	memset(w->sets, 0, w->num_sets * sizeof(hot_set));
+	w->root = root;
+	w->version = version;
+	w->flushes++;
+}
+
+static void grow_miss_buffers(hot_worker *w, int n)
+{
+	if (n <= w->miss_size)
+		return;
+
+	free(w->miss_keys);
+	free(w->miss_pos);
+	free(w->miss_found);
+	w->miss_size = n;
+	if ((w->miss_keys = (int *)malloc(n * sizeof(int))) == NULL ||
+		(w->miss_pos = (int *)malloc(n * sizeof(int))) == NULL ||
+		(w->miss_found = (node **)malloc(n * sizeof(node *))) == NULL) {
+		printf("Error allocating memory for the hot key cache misses.\n");
+		exit(1);
+	}
+}
+
+/* Returns 1 and the node of the key if the set holds it. A node deleted
+ * or unlinked since it was cached is dropped. Its memory belongs to the node
+ * pool and is still readable. */
+static inline int lookup(hot_worker *w, hot_set *set, int key, node **found)
+{
+	node *tmp_node;
+
+	for (int way = 0; way < HOT_CACHE_WAYS; way++) {
+		if (!((set->valid >> way) & 1) || set->keys[way] != key)
+			continue;
+
+		tmp_node = set->nodes[way];
+		if (tmp_node && (tmp_node->value != key || bst_load_int(&tmp_node->deleted))) {
+			set->valid &= ~(1u << way);
+			w->stale++;
+			return 0;
+		}
+
+		*found = tmp_node;
+		return 1;
+	}
+
+	return 0;
+}
+
+/* Caches the node of the key. A key missed twice in one batch is already
+ * in the set after the first fill, its way is updated in place. */
+static inline void fill(hot_set *set, int key, node *found)
+{
+	int way;
+
+	for (way = 0; way < HOT_CACHE_WAYS; way++) {
+		if (((set->valid >> way) & 1) && set->keys[way] == key)
+			break;
+	}
+
+	if (way == HOT_CACHE_WAYS) {
+		for (way = 0; way < HOT_CACHE_WAYS; way++) {
+			if (!((set->valid >> way) & 1))
+				break;
+		}
+	}
+
+	if (way == HOT_CACHE_WAYS) {
+		way = set->victim;
+		set->victim = (set->victim + 1) % HOT_CACHE_WAYS;
+	}
+
+	set->keys[way] = key;
+	set->nodes[way] = found;
+	set->valid |= 1u << way;
+}
+
+/* Resolves keys [begin, end) from the worker's cache and hands the misses
+ * to miss as one batch. Runs inside the read epoch of the search. */
+void hot_cache_search(node *root, long long version, int *keys, node **found_keys, int begin, int end,
+	int worker_id, hot_cache_miss_fn miss, void *miss_arg)
+{
+	hot_worker *w;
+	int num_miss = 0;
+	int key;
+
+	if (worker_id >= HOT_CACHE_MAX_THREADS) {
+		printf("Error: more than %d threads using the hot key cache.\n", HOT_CACHE_MAX_THREADS);
+		exit(1);
+	}
+
+	w = &workers[worker_id];
+	if (w->root != root || w->version != version || w->num_sets != cache_sets)
+		flush_worker(w, root, version);
+
+	grow_miss_buffers(w, end - begin);
+
+	for (int i = begin; i < end; i++) {
+		key = keys[i];
+		if (lookup(w, set_of(w, key), key, &found_keys[i])) {
+			w->hits++;
+			continue;
+		}
+
+		w->miss_keys[num_miss] = key;
+		w->miss_pos[num_miss] = i;
+		num_miss++;
+	}
+
+	w->misses += num_miss;
+	if (!num_miss)
+		return;
+
+	miss(miss_arg, w->miss_keys, w->miss_found, num_miss, worker_id);
+
+	for (int i = 0; i < num_miss; i++) {
+		found_keys[w->miss_pos[i]] = w->miss_found[i];
+		fill(set_of(w, w->miss_keys[i]), w->miss_keys[i], w->miss_found[i]);
+	}
+}
+
+void hot_cache_release(void)
+{
+	for (int i = 0; i < HOT_CACHE_MAX_THREADS; i++) {
+		bst_aligned_free(workers[i].sets);
+		free(workers[i].miss_keys);
+		free(workers[i].miss_pos);
+		free(workers[i].miss_found);
+		workers[i].sets = NULL;
+		workers[i].num_sets = 0;
+		workers[i].root = NULL;
+		workers[i].miss_keys = NULL;
+		workers[i].miss_pos = NULL;
+		workers[i].miss_found = NULL;
+		workers[i].miss_size = 0;
+	}
+}
+
+void hot_cache_reset_stats(void)
+{
+	for (int i = 0; i < HOT_CACHE_MAX_THREADS; i++) {
+		workers[i].hits = 0;
+		workers[i].misses = 0;
+		workers[i].stale = 0;
+		workers[i].flushes = 0;
+	}
+}
+
+void hot_cache_print_stats(void)
+{
+	long long hits = 0, misses = 0, stale = 0, flushes = 0;
+
+	if (!num_entries_used)
+		return;
+
+	for (int i = 0; i < HOT_CACHE_MAX_THREADS; i++) {
+		hits += workers[i].hits;
+		misses += workers[i].misses;
+		stale += workers[i].stale;
+		flushes += workers[i].flushes;
+	}
+
+	printf("Hot key cache: %d entries per thread, %lld hits, %lld misses (%.2f%% hit rate), %lld stale, %lld flushes\n",
+		num_entries_used, hits, misses, (hits + misses) ? 100.0 * hits / (hits + misses) : 0.0, stale, flushes);
+}
@@ -0,0 +1,23 @@
+#ifndef HOT_CACHE_H_
+#define HOT_CACHE_H_
+
+#include "hsa_BST_search.h"
+
+/* Ways of a set, the keys and node pointers of a set fill one cache line. */
+#define HOT_CACHE_WAYS 4
+
+/* Largest number of threads with a cache of their own. */
+#define HOT_CACHE_MAX_THREADS 256
+
+/* Searches the n keys the cache missed, found[i] is the node of keys[i]. */
+typedef void (*hot_cache_miss_fn)(void *arg, int *keys, node **found, int n, int worker_id);
+
+int hot_cache_configure(int num_entries);
+int hot_cache_entries(void);
+void hot_cache_search(node *root, long long version, int *keys, node **found_keys, int begin, int end,
+	int worker_id, hot_cache_miss_fn miss, void *miss_arg);
+void hot_cache_release(void);
+void hot_cache_reset_stats(void);
+void hot_cache_print_stats(void);
+
+#endif
@@ -37,6 +37,9 @@ THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <limits.h>
+#include <thread>
+#include <atomic>
 #include <search.h>
 #include <process.h>  
 #include <windows.h>
@@ -44,6 +47,19 @@ THE POSSIBILITY OF SUCH DAMAGE.
 #include "hsa_BST_search.h"
 #include "ocl_BST_search.h"
 #include "cpu_BST.h"
+#include "eytzinger.h"
+#include "thread_pool.h"
+#include "sorted_search.h"
+#include "bound_search.h"
+#include "range_search.h"
+#include "order_stat.h"
+#include "keyed_tree.h"
+#include "workload.h"
+#include "hot_cache.h"
+#include "node_arena.h"
+#include "numa_replica.h"
+#include "radix_sort.h"
+#include "epoch.h"
 #include "svm_data_struct.h"
 #include "SDKUtil.hpp"
 using namespace appsdk;
@@ -60,9 +76,29 @@ static long long int num_search_keys;
 static node *root = NULL;
 static node *data = NULL;
 static ocl_node *ocl_tree = NULL;
+static node_arena *arena = NULL;	// Holds data and ocl_tree with -H
+static int arena_pages = -1;		// ARENA_PAGES_*, -1 allocates with malloc
 
 static node **found_key_nodes = NULL;
 static int use_ocl = 0;
+static int ocl_layout = OCL_LAYOUT_BFS;
+static int bound_query = BOUND_NONE;
+static int range_width = 0;
+static int *range_hi = NULL;		// ends of the ranges [search_keys[i], range_hi[i])
+static int *range_offsets = NULL;
+static cl_kernel range_scan_kernel = NULL;	// ocl_range_scan, the second pass of -r on the Orca stack
+static cl_mem cl_range_offsets = NULL;
+static cl_mem cl_range_ids = NULL;
+static int *ocl_range_ids = NULL;
+static int ocl_range_ids_size = 0;
+static int ocl_range_total = 0;
+static int order_query = ORDER_NONE;
+static int *order_ranks = NULL;
+static int key_bits = 0;
+static workload search_load;
+static int search_batch = 0;
+static int *tree_keys = NULL;
+static node *update_nodes = NULL;	// Nodes inserted again by run_concurrent_updates
 static svm_mutex *mutex = NULL;
 static int *found_keys = NULL;
 static int *found_nodes_id = NULL;
@@ -73,51 +109,54 @@ static int timer;
 static int found_count = 0;
 
 static int num_cpu_nodes = 256;
+static int sort_keys = 0;
+static int build_mode = 0;
+static int insert_percent = 0;
+static int delete_percent = 0;
 static long long int num_gpu_nodes; 
 static long long int num_gpu_wi; 
 static size_t globalSize;
 
 static cl_context context;
 
-static int compare(void *context, const void *num1, const void *num2)
-{
-	int val1 = *(const int *)num1;
-	int val2 = *(const int *)num2;
-
-	if (val1 < val2)
-		return -1;
-
-	else if (val1 == val2)
-		return 0;
-
-	else 
-		return 1;
-}
-
+/* Sorts the keys in place with the parallel radix sort, so that the searches
+ * of neighbouring work items and threads walk the same paths. */
 static void sort_search_array(int *array, int num_elem)
 {
-	qsort_s(array, num_elem, sizeof(int), compare, NULL);
+	radix_sort(array, NULL, num_elem);
 	//printf("Using sorted serach keys...\n");
 }
 
 
+/* Every call fills the next batch of the search key stream, so the batches
+ * of a run differ but are the same from run to run with the same seed. */
 static void initialize_search_keys(int *search_keys, long long int num_search_keys)
 {
+	workload_fill(&search_load, WORKLOAD_STREAM_SEARCH + search_batch++, search_keys, num_search_keys);
 
-	static int rand_seed_it = 0;
-	if (rand_seed_it)
-		srand(time(NULL));
-	else
-		srand(1);
+	if (sort_keys)
+		sort_search_array(search_keys, num_search_keys);
+}
 
-	rand_seed_it = (rand_seed_it + 1) % 2;
+/* With -r, every search key starts a range of range_width keys */
+static void initialize_range_ends(int *search_keys, long long int num_search_keys)
+{
+	if (!range_hi && (range_hi = (int *)malloc(num_search_keys * sizeof(int))) == NULL) {
+		printf("Error allocating memory for range ends.\n");
+		exit(1);
+	}
 
 	for (int i = 0; i < num_search_keys; i++)
-	{
-		search_keys[i] = rand();		
-	}
+		range_hi[i] = (search_keys[i] > INT_MAX - range_width) ? INT_MAX : search_keys[i] + range_width;
+}
 
-	//sort_search_array(search_keys, num_search_keys);
+/* With -k 2, the search keys are turned into ranks of keys in the tree */
+static void initialize_select_ranks(int *search_keys, long long int num_search_keys)
+{
+	int num_keys = count_node(root);
+
+	for (int i = 0; i < num_search_keys; i++)
+		search_keys[i] = num_keys ? search_keys[i] % num_keys : 0;
 }
 
 static void initialize_mutex_array(svm_mutex *mutex, long long int n)
@@ -127,6 +166,14 @@ static void initialize_mutex_array(svm_mutex *mutex, long long int n)
 	}
 }
 
+/* Keys the search kernels answer: each of the globalSize work items takes
+ * num_keys / globalSize of them, the tail of the batch is not searched and
+ * its entries of the result buffer are not written. */
+static int keys_searched(long long num_keys)
+{
+	return globalSize ? (int)(globalSize * (num_keys / globalSize)) : 0;
+}
+
 static int get_next_search_per_wi(int *val)
 {
 	printf("Enter 0 to continue and do cpu search. \nElse enter the next search keys per wi: ");
@@ -150,12 +197,89 @@ static int get_next_num_cpu_threads(int *val)
 	return *val;
 }
 
+static const char *build_mode_name(int mode)
+{
+	switch (mode) {
+	case 1: return "bulk load";
+	case 2: return "AVL insert";
+	case 3: return "AVL sorted batch insert";
+	default: return "insert";
+	}
+}
+
 static void construct_bst_tree()
 {
-	num_cpu_nodes = num_nodes;
+	/* With -u, the last insert_percent of the nodes are inserted
+	 * concurrently after the initial tree is built */
+	num_cpu_nodes = num_nodes - (int)(num_nodes * insert_percent / 100);
 	
 	/* Construct initial BST in the cpu */
-	root = construct_BST(num_cpu_nodes, data);
+	sdk_timer->resetTimer(timer);
+	sdk_timer->startTimer(timer);
+	switch (build_mode) {
+	case 1:
+		root = bulk_load_BST(num_cpu_nodes, data);
+		break;
+	case 2:
+		root = NULL;
+		for (int i = 0; i < num_cpu_nodes; i++)
+			root = avl_insert(root, &data[i]);
+		break;
+	case 3:
+		root = avl_insert_batch(NULL, data, num_cpu_nodes);
+		break;
+	default:
+		root = construct_BST(num_cpu_nodes, data);
+		break;
+	}
+	sdk_timer->stopTimer(timer);
+	printf("Time to build the tree on the CPU (%s) = %.10f ms\n",
+		build_mode_name(build_mode), 1000 * sdk_timer->readTimer(timer));
+
+	if (num_cpu_nodes < num_nodes) {
+		sdk_timer->resetTimer(timer);
+		sdk_timer->startTimer(timer);
+		multithreaded_insert(&root, data + num_cpu_nodes, (int)(num_nodes - num_cpu_nodes), thread_pool_size());
+		sdk_timer->stopTimer(timer);
+		printf("Time to insert %lld nodes with %d cpu threads = %.10f ms\n",
+			num_nodes - num_cpu_nodes, thread_pool_size(), 1000 * sdk_timer->readTimer(timer));
+	}
+
+	/* With -d, the keys of the first delete_percent of the nodes are
+	 * deleted again */
+	if (delete_percent) {
+		int num_delete = (int)(num_nodes * delete_percent / 100);
+		int *delete_keys_array;
+		int deleted;
+
+		if ((delete_keys_array = (int *)malloc(num_delete * sizeof(int))) == NULL) {
+			printf("Error allocating memory for delete keys.\n");
+			exit(1);
+		}
+		for (int i = 0; i < num_delete; i++)
+			delete_keys_array[i] = data[i].value;
+
+		sdk_timer->resetTimer(timer);
+		sdk_timer->startTimer(timer);
+		deleted = delete_keys(&root, delete_keys_array, num_delete);
+		sdk_timer->stopTimer(timer);
+		printf("Time to delete %d nodes on the CPU = %.10f ms\n", deleted, 1000 * sdk_timer->readTimer(timer));
+		epoch_print_stats();
+
+		free(delete_keys_array);
+	}
+
+	/* The zipf and hit ratio search keys are drawn from the live keys */
+	if ((tree_keys = (int *)malloc(num_nodes * sizeof(int))) == NULL) {
+		printf("Error allocating memory for tree keys.\n");
+		exit(1);
+	}
+	search_load.num_tree_keys = 0;
+	for (int i = 0; i < num_nodes; i++) {
+		if (!data[i].deleted)
+			tree_keys[search_load.num_tree_keys++] = data[i].value;
+	}
+	search_load.tree_keys = tree_keys;
 
 #if 0
 	globalSize = (size_t)num_gpu_nodes;
@@ -204,7 +328,7 @@ static void init_globals_and_create_tree()
 			printf("Error allocating memory for nodes.\n");
 			exit(1);
 		}
-		initialize_nodes(data, num_nodes);
+		initialize_nodes(data, num_nodes, search_load.seed);
 
 		//Used only by the insert_kernel.
 		num_gpu_nodes = num_nodes - num_cpu_nodes;
@@ -231,12 +355,19 @@ static void init_globals_and_create_tree()
 		memset(found_key_nodes, 0, num_search_keys * sizeof(node *));
 	}
 	else {
-		/* Data allocation and initialization */
-		if ((data = (node *)malloc(num_nodes * sizeof(node))) == NULL) {
+		/* Data allocation and initialization. The arena keeps the node
+		 * pool and the flattened tree on huge pages. */
+		if (arena_pages >= 0) {
+			arena = arena_create(num_nodes * (sizeof(node) + sizeof(ocl_node)) + 128, arena_pages);
+			data = (node *)arena_alloc(arena, num_nodes * sizeof(node));
+			ocl_tree = (ocl_node *)arena_alloc(arena, num_nodes * sizeof(ocl_node));
+			arena_print_stats(arena);
+		}
+		else if ((data = (node *)malloc(num_nodes * sizeof(node))) == NULL) {
 			printf("Error allocating memory for nodes.\n");
 			exit(1);
 		}
-		initialize_nodes(data, num_nodes);
+		initialize_nodes(data, num_nodes, search_load.seed);
 
 		if ((search_keys = (int *)malloc(num_search_keys * sizeof(int))) == NULL) {
 			printf("Error allocating memory for search keys.\n");
@@ -244,7 +375,8 @@ static void init_globals_and_create_tree()
 		}
 		initialize_search_keys(search_keys, num_search_keys);
 
-		if ((found_keys = (int *)malloc(num_search_keys * sizeof(int))) == NULL) {
+		/* One more entry for the total of the range scan offsets */
+		if ((found_keys = (int *)malloc((num_search_keys + 1) * sizeof(int))) == NULL) {
 			printf("Error allocating memory for found keys.\n");
 			exit(1);
 		}
@@ -256,7 +388,7 @@ static void init_globals_and_create_tree()
 
 		memset(found_key_nodes, 0, num_search_keys * sizeof(node *));
 
-		if ((ocl_tree = (ocl_node *)malloc(num_nodes * sizeof(ocl_node))) == NULL) {
+		if (!ocl_tree && (ocl_tree = (ocl_node *)malloc(num_nodes * sizeof(ocl_node))) == NULL) {
 			printf("Error allocating memory for nodes.\n");
 			exit(1);
 		}
@@ -283,93 +415,190 @@ static void update_found_nodes(node *root, node *tree, int *found_nodes_id, int
 #endif
 }
 
-static void convert_tree_to_array(node *root, ocl_node *ocl_tree, int *root_id)
+static int count_ocl_nodes(ocl_node *ocl_tree, int id)
 {
+	int count = -1;
+	if (id != -1)
+		count = 1;
 
-#if 0
-	/* Method 1 : Uses the fact that the nodes are pre-malloced and they are in contigous memory.
-	 * Will fail in case malloc couldnt return continous memory region.
-	 */
-	int id;
-
-	for (int i = 0; i < num_nodes;	 i++) {
-		ocl_tree[i].value = tree[i].value;
-		ocl_tree[i].height = tree[i].height;
-		ocl_tree[i].right  = (!tree[i].right) ? -1 : (int)(((uintptr_t)tree[i].right - (uintptr_t)tree) / sizeof(node));
-		ocl_tree[i].left   = (!tree[i].left) ? -1 : (int)(((uintptr_t)tree[i].left - (uintptr_t)tree) / sizeof(node));
-		ocl_tree[i].parent = -1;
-	}
+	if (ocl_tree[id].left != -1)
+		count += count_ocl_nodes(ocl_tree, ocl_tree[id].left);
 
-	*root_id = (!root) ? -1 : (int)((uintptr_t)root - (uintptr_t)tree);		
-#endif
-	node **tree_queue;
-	node *tmp;
+	if (ocl_tree[id].right != -1)
+		count += count_ocl_nodes(ocl_tree, ocl_tree[id].right);
 
-	if ((tree_queue = (node **)calloc(num_nodes, sizeof(node *))) == NULL) {
-		printf("Error creating tree queue.\n");
-		exit(1);
-	}
+	return count;
+}
 
-	long long int front = 0;
-	long long int rear  = 0;
+static int verify_ocl_tree(ocl_node *ocl_tree, int num_nodes)
+{
+	return (num_nodes == count_ocl_nodes(ocl_tree, 0));
+}
 
-	tree_queue[rear] = root;
-	ocl_tree[rear].value = root->value;
-	ocl_tree[rear].height = root->height; 
-	ocl_tree[rear].parent = -1;
-	rear++;
+/* Second pass of the range queries on the device. The counts of the first
+ * pass, in found_keys, give each range its offset and ocl_range_scan packs
+ * the node indices of all ranges in ocl_range_ids. The kernels cover the
+ * first num_ranges - num_ranges % globalSize ranges. */
+static void run_ocl_range_scan(cl_command_queue queue, int num_ranges, size_t preferredLocalSize)
+{
+	int covered = (int)(globalSize * (num_ranges / globalSize));
+	cl_int status;
 
-	*root_id = 0;
+	ocl_range_total = range_prefix_offsets(found_keys, covered);
+	if (!ocl_range_total)
+		return;
 
-	while (front != rear) {
-		tmp = tree_queue[front];
-		if (!tmp)
-			break;
+	if (ocl_range_total > ocl_range_ids_size) {
+		if (cl_range_ids)
+			clReleaseMemObject(cl_range_ids);
+		free(ocl_range_ids);
 
-		if (tmp->left) {
-			tree_queue[rear] = tmp->left;
-			ocl_tree[rear].value = tmp->left->value;
-			ocl_tree[rear].height = tmp->left->height;
-			ocl_tree[rear].parent = -1;
-			ocl_tree[front].left = rear;
-			rear++;
-		}
+		cl_range_ids = clCreateBuffer(context, CL_MEM_WRITE_ONLY, ocl_range_total * sizeof(int), NULL, &status);
+		ASSERT_CL(status, "Error creating cl_range_ids\n");
 
-		if (tmp->right) {
-			tree_queue[rear] = tmp->right;
-			ocl_tree[rear].value = tmp->right->value;
-			ocl_tree[rear].height = tmp->right->height;
-			ocl_tree[rear].parent = -1;
-			ocl_tree[front].right = rear;
-			rear++;
+		if ((ocl_range_ids = (int *)malloc(ocl_range_total * sizeof(int))) == NULL) {
+			printf("Error allocating memory for the range scan.\n");
+			exit(1);
 		}
+		ocl_range_ids_size = ocl_range_total;
 
-		front++;
+		status = clSetKernelArg(range_scan_kernel, 6, sizeof(cl_range_ids), &cl_range_ids);
+		ASSERT_CL(status, "Error set range_scan_kernel arg.");
 	}
 
-	if (tree_queue)
-		free(tree_queue);
+	status = clEnqueueWriteBuffer(queue, cl_range_offsets, CL_FALSE, 0, covered * sizeof(int), found_keys, 0, NULL, NULL); 
+	ASSERT_CL(status, "Error clEnqueueWriteBuffer for cl_range_offsets\n");
+
+	status = clEnqueueNDRangeKernel(queue, range_scan_kernel, 1, NULL, &globalSize, &preferredLocalSize, 0, NULL, NULL);
+	ASSERT_CL(status, "Error when enqueuing range_scan_kernel");
 
+	status = clEnqueueReadBuffer(queue, cl_range_ids, CL_TRUE, 0, ocl_range_total * sizeof(int), ocl_range_ids, 0, NULL, NULL); 
+	ASSERT_CL(status, "Error clEnqueueReadBuffer for cl_range_ids\n");
 }
 
-static int count_ocl_nodes(ocl_node *ocl_tree, int id)
+/* Searches the templated tree with the ocl_search_keyed kernel. The tree,
+ * its keys and the search batches are those of run_keyed_benchmark, the
+ * tree goes to the device as the BFS arrays of Tree::flatten(). */
+template <typename Key, typename Value>
+static void run_keyed_ocl(const char *name, cl_command_queue queue, cl_program program, int iteration, int search_per_wi, size_t preferredLocalSize)
 {
-	int count = -1;
-	if (id != -1)
-		count = 1;
+	typedef Tree<Key, Value> tree_type;
+	tree_type tree((int)num_nodes);
+	Key *keys, *tree_keys, *keyed_search;
+	Value *values;
+	int *left, *right, *found_ids;
+	int root_id, keyed_found = 0, mismatch = 0;
+	int n = (int)num_nodes, num_keys = (int)num_search_keys;
+	float search_time = 0;
+	cl_int status;
 
-	if (ocl_tree[id].left != -1)
-		count += count_ocl_nodes(ocl_tree, ocl_tree[id].left);
+	if ((keys = (Key *)malloc(n * sizeof(Key))) == NULL ||
+		(values = (Value *)malloc(n * sizeof(Value))) == NULL ||
+		(tree_keys = (Key *)malloc(n * sizeof(Key))) == NULL ||
+		(left = (int *)malloc(n * sizeof(int))) == NULL ||
+		(right = (int *)malloc(n * sizeof(int))) == NULL ||
+		(keyed_search = (Key *)malloc(num_keys * sizeof(Key))) == NULL ||
+		(found_ids = (int *)malloc(num_keys * sizeof(int))) == NULL) {
+		printf("Error allocating memory for the keyed OpenCL search.\n");
+		exit(1);
+	}
 
-	if (ocl_tree[id].right != -1)
-		count += count_ocl_nodes(ocl_tree, ocl_tree[id].right);
+	keyed_tree_keys(keys, values, n, search_load.seed);
+	tree.bulk_load(keys, values, n);
 
-	return count;
-}
+	sdk_timer->resetTimer(timer);
+	sdk_timer->startTimer(timer);
+	root_id = tree.flatten(tree_keys, left, right);
+	sdk_timer->stopTimer(timer);
+	printf("Time to flatten the %s tree on the CPU = %.10f ms\n", name, 1000 * sdk_timer->readTimer(timer));
 
-static int verify_ocl_tree(ocl_node *ocl_tree, int num_nodes)
-{
-	return (num_nodes == count_ocl_nodes(ocl_tree, 0));
+	cl_kernel keyed_kernel = clCreateKernel(program, "ocl_search_keyed", &status);
+	ASSERT_CL(status, "Error creating kernel.\n");
+
+	cl_mem cl_tree_keys = clCreateBuffer(context, CL_MEM_READ_ONLY, n * sizeof(Key), NULL, &status);
+	ASSERT_CL(status, "Error creating cl_tree_keys\n");
+
+	cl_mem cl_left = clCreateBuffer(context, CL_MEM_READ_ONLY, n * sizeof(int), NULL, &status);
+	ASSERT_CL(status, "Error creating cl_left\n");
+
+	cl_mem cl_right = clCreateBuffer(context, CL_MEM_READ_ONLY, n * sizeof(int), NULL, &status);
+	ASSERT_CL(status, "Error creating cl_right\n");
+
+	cl_mem cl_keyed_search = clCreateBuffer(context, CL_MEM_READ_ONLY, num_keys * sizeof(Key), NULL, &status);
+	ASSERT_CL(status, "Error creating cl_keyed_search\n");
+
+	cl_mem cl_found_ids = clCreateBuffer(context, CL_MEM_WRITE_ONLY, num_keys * sizeof(int), NULL, &status);
+	ASSERT_CL(status, "Error creating cl_found_ids\n");
+
+	status = clEnqueueWriteBuffer(queue, cl_tree_keys, CL_TRUE, 0, n * sizeof(Key), tree_keys, 0, NULL, NULL);
+	status |= clEnqueueWriteBuffer(queue, cl_left, CL_TRUE, 0, n * sizeof(int), left, 0, NULL, NULL);
+	status |= clEnqueueWriteBuffer(queue, cl_right, CL_TRUE, 0, n * sizeof(int), right, 0, NULL, NULL);
+	ASSERT_CL(status, "Error clEnqueueWriteBuffer for the keyed tree\n");
+
+	cl_uint arg = 0;
+	status  = clSetKernelArg(keyed_kernel, arg++, sizeof(cl_tree_keys), &cl_tree_keys);
+	status |= clSetKernelArg(keyed_kernel, arg++, sizeof(cl_left), &cl_left);
+	status |= clSetKernelArg(keyed_kernel, arg++, sizeof(cl_right), &cl_right);
+	status |= clSetKernelArg(keyed_kernel, arg++, sizeof(cl_int), &root_id);
+	status |= clSetKernelArg(keyed_kernel, arg++, sizeof(cl_keyed_search), &cl_keyed_search);
+	status |= clSetKernelArg(keyed_kernel, arg++, sizeof(cl_int), &num_keys);
+	status |= clSetKernelArg(keyed_kernel, arg++, sizeof(cl_found_ids), &cl_found_ids);
+	ASSERT_CL(status, "Error set keyed_kernel arg.");
+
+	globalSize = (size_t)(num_keys / search_per_wi);
+
+	for (int it = 0; it < iteration; it++) {
+		keyed_search_keys(keyed_search, num_keys, keys, n, search_load.seed, it);
+
+		sdk_timer->resetTimer(timer);
+		sdk_timer->startTimer(timer);
+
+		status = clEnqueueWriteBuffer(queue, cl_keyed_search, CL_FALSE, 0, num_keys * sizeof(Key), keyed_search, 0, NULL, NULL);
+		ASSERT_CL(status, "Error clEnqueueWriteBuffer for cl_keyed_search\n");
+
+		status = clEnqueueNDRangeKernel(queue, keyed_kernel, 1, NULL, &globalSize, &preferredLocalSize, 0, NULL, NULL);
+		ASSERT_CL(status, "Error when enqueuing keyed_kernel");
+
+		status = clEnqueueReadBuffer(queue, cl_found_ids, CL_TRUE, 0, num_keys * sizeof(int), found_ids, 0, NULL, NULL);
+		ASSERT_CL(status, "Error clEnqueueReadBuffer for cl_found_ids\n");
+
+		sdk_timer->stopTimer(timer);
+		search_time += sdk_timer->readTimer(timer);
+	}
+
+	/* Each answer of the last batch is checked against the cpu tree */
+	for (int i = 0; i < keys_searched(num_keys); i++) {
+		const typename tree_type::tree_node *tmp_node = tree.find(keyed_search[i]);
+
+		if (found_ids[i] != -1)
+			keyed_found++;
+		if ((found_ids[i] == -1) != (tmp_node == NULL) ||
+			(found_ids[i] != -1 && !key_equal(tree_keys[found_ids[i]], keyed_search[i])))
+			mismatch++;
+	}
+
+	printf("Avg time to search %d %s keys on the GPU = %.10f ms\n", num_keys, name, 1000 * (search_time / iteration));
+	printf("Total keys found: %d\n", keyed_found);
+	if (mismatch) {
+		printf("%d keyed results differ from the cpu tree.\n", mismatch);
+		exit(1);
+	}
+	printf("\n");
+
+	clReleaseMemObject(cl_tree_keys);
+	clReleaseMemObject(cl_left);
+	clReleaseMemObject(cl_right);
+	clReleaseMemObject(cl_keyed_search);
+	clReleaseMemObject(cl_found_ids);
+	clReleaseKernel(keyed_kernel);
+
+	free(keys);
+	free(values);
+	free(tree_keys);
+	free(left);
+	free(right);
+	free(keyed_search);
+	free(found_ids);
 }
 
 static void run_ocl_path(int iteration, int search_per_wi, size_t preferredLocalSize)
@@ -419,7 +648,7 @@ static void run_ocl_path(int iteration, int search_per_wi, size_t preferredLocal
 	cl_program program = clCreateProgramWithSource(context, 1, &kernelCString, NULL, &status);
 	ASSERT_CL(status, "Error when creating CL program");
 
-	status = clBuildProgram(program, 1, &devices[0], "-I . ", NULL, NULL);
+	status = clBuildProgram(program, 1, &devices[0], keyed_ocl_options(key_bits), NULL, NULL);
 	if (status != CL_SUCCESS) {
 		char buildLog[BUILD_LOG_SIZE];
 		status = clGetProgramBuildInfo(program, devices[0], CL_PROGRAM_BUILD_LOG, BUILD_LOG_SIZE, buildLog, NULL);
@@ -427,15 +656,111 @@ static void run_ocl_path(int iteration, int search_per_wi, size_t preferredLocal
 		ASSERT_CL(status, "Error when building CL program");
 	}
 
-	cl_kernel search_kernel = clCreateKernel(program, "ocl_search", &status);
+	/* With -x the program is built for the keyed tree and only
+	 * ocl_search_keyed runs */
+	if (key_bits) {
+		switch (key_bits) {
+		case 64:
+			run_keyed_ocl<uint64_t, uint64_t>("64 bit", queue, program, iteration, search_per_wi, preferredLocalSize);
+			break;
+		case 128:
+			run_keyed_ocl<key128, uint64_t>("16 byte", queue, program, iteration, search_per_wi, preferredLocalSize);
+			break;
+		default:
+			run_keyed_ocl<uint32_t, uint32_t>("32 bit", queue, program, iteration, search_per_wi, preferredLocalSize);
+			break;
+		}
+
+		clReleaseCommandQueue(queue);
+		clReleaseProgram(program);
+		clReleaseContext(context);
+		free(devices);
+		return;
+	}
+
+	const char *kernel_name;
+	size_t tree_size;
+
+	switch (ocl_layout) {
+	case OCL_LAYOUT_EYTZINGER:
+		kernel_name = "ocl_search_eytzinger";
+		tree_size = (num_nodes + 1) * sizeof(int);
+		break;
+	case OCL_LAYOUT_COMPACT:
+		kernel_name = "ocl_search_compact";
+		tree_size = num_nodes * sizeof(ocl_compact_node);
+		break;
+	case OCL_LAYOUT_SOA:
+		kernel_name = "ocl_search_soa";
+		tree_size = num_nodes * sizeof(int);
+		break;
+	default:
+		kernel_name = "ocl_search";
+		tree_size = num_nodes * sizeof(ocl_node);
+		break;
+	}
+
+	/* The nearest key queries run on the BFS ocl_node array */
+	if (bound_query != BOUND_NONE) {
+		if (ocl_layout != OCL_LAYOUT_BFS)
+			printf("%s queries use the BFS ocl_node array.\n", bound_query_name(bound_query));
+		ocl_layout = OCL_LAYOUT_BFS;
+		kernel_name = "ocl_bound_search";
+		tree_size = num_nodes * sizeof(ocl_node);
+	}
+
+	/* So do the order statistics, which read the subtree sizes */
+	if (order_query != ORDER_NONE) {
+		if (ocl_layout != OCL_LAYOUT_BFS)
+			printf("Rank and select use the BFS ocl_node array.\n");
+		ocl_layout = OCL_LAYOUT_BFS;
+		kernel_name = (order_query == ORDER_RANK) ? "ocl_rank" : "ocl_select";
+		tree_size = num_nodes * sizeof(ocl_node);
+	}
+
+	/* So do the range counts, which walk the parent indices */
+	if (range_width) {
+		if (ocl_layout != OCL_LAYOUT_BFS)
+			printf("Range queries use the BFS ocl_node array.\n");
+		ocl_layout = OCL_LAYOUT_BFS;
+		kernel_name = "ocl_range_count";
+		tree_size = num_nodes * sizeof(ocl_node);
+	}
+
+	cl_kernel search_kernel = clCreateKernel(program, kernel_name, &status);
 	ASSERT_CL(status, "Error creating kernel.\n");
 
-	cl_mem cl_ocl_tree = clCreateBuffer(context, CL_MEM_READ_ONLY, num_nodes * sizeof(ocl_node), NULL, &status);
+	cl_mem cl_ocl_tree = clCreateBuffer(context, CL_MEM_READ_ONLY, tree_size, NULL, &status);
 	ASSERT_CL(status, "Error creating cl_ocl_tree\n");
 
+	/* The SoA layout sends the keys in cl_ocl_tree and the child indices
+	 * in two more buffers. */
+	cl_mem cl_soa_left = NULL, cl_soa_right = NULL;
+	if (ocl_layout == OCL_LAYOUT_SOA) {
+		cl_soa_left = clCreateBuffer(context, CL_MEM_READ_ONLY, num_nodes * sizeof(int), NULL, &status);
+		ASSERT_CL(status, "Error creating cl_soa_left\n");
+
+		cl_soa_right = clCreateBuffer(context, CL_MEM_READ_ONLY, num_nodes * sizeof(int), NULL, &status);
+		ASSERT_CL(status, "Error creating cl_soa_right\n");
+	}
+
 	cl_mem cl_search_keys = clCreateBuffer(context, CL_MEM_READ_ONLY, num_search_keys * sizeof(int), NULL, &status);
 	ASSERT_CL(status, "Error creating cl_search_keys\n");
 
+	/* The range ends, the search keys are the range starts. The scan
+	 * kernel writes the ranges at the offsets of the counts */
+	cl_mem cl_range_hi = NULL;
+	if (range_width) {
+		cl_range_hi = clCreateBuffer(context, CL_MEM_READ_ONLY, num_search_keys * sizeof(int), NULL, &status);
+		ASSERT_CL(status, "Error creating cl_range_hi\n");
+
+		cl_range_offsets = clCreateBuffer(context, CL_MEM_READ_ONLY, num_search_keys * sizeof(int), NULL, &status);
+		ASSERT_CL(status, "Error creating cl_range_offsets\n");
+
+		range_scan_kernel = clCreateKernel(program, "ocl_range_scan", &status);
+		ASSERT_CL(status, "Error creating kernel.\n");
+	}
+
 	cl_mem cl_found_nodes_id = clCreateBuffer(context, CL_MEM_WRITE_ONLY, num_search_keys * sizeof(int), NULL, &status);
 	ASSERT_CL(status, "Error creating cl_search_keys\n");
 
@@ -443,13 +768,52 @@ static void run_ocl_path(int iteration, int search_per_wi, size_t preferredLocal
 
 	/* Search begins */
 	int root_id;
+	eytzinger_tree *eyt_tree = NULL;
+	ocl_compact_node *compact_tree = NULL;
+	ocl_soa_tree *soa_tree = NULL;
+	void *host_tree = ocl_tree;
+	node *live_root, *live_copies;
+	int live_count;
+	long long int emitted = 0;
 
 	sdk_timer->resetTimer(timer);
 	sdk_timer->startTimer(timer);
 
+	/* The kernels do not check deleted nodes, the device layouts only hold
+	 * the live keys */
+	live_root = build_live_tree(root, &live_count, &live_copies);
+
 	/* Covert tree to array and send the data to device */
-	convert_tree_to_array(root, ocl_tree, &root_id);
-	//convert_tree_to_array(root, ocl_tree, 0);
+	if (ocl_layout == OCL_LAYOUT_EYTZINGER) {
+		int count;
+		node **sorted = collect_live(root, &count);
+		eyt_tree = eytzinger_build(sorted, count);
+		free(sorted);
+
+		/* The eytzinger kernel takes the number of nodes where ocl_search
+		 * takes the root id. */
+		root_id = count;
+		host_tree = eyt_tree->keys;
+	}
+	else if (ocl_layout == OCL_LAYOUT_COMPACT) {
+		if ((compact_tree = (ocl_compact_node *)malloc(num_nodes * sizeof(ocl_compact_node))) == NULL) {
+			printf("Error allocating memory for compact nodes.\n");
+			exit(1);
+		}
+		emitted = convert_tree_to_compact_array(live_root, num_nodes, compact_tree, NULL, &root_id);
+		host_tree = compact_tree;
+	}
+	else if (ocl_layout == OCL_LAYOUT_SOA) {
+		soa_tree = alloc_soa_tree(num_nodes);
+		emitted = convert_tree_to_soa_array(live_root, num_nodes, soa_tree, NULL, &root_id);
+		host_tree = soa_tree->keys;
+	}
+	else {
+		emitted = convert_tree_to_array(live_root, num_nodes, ocl_tree, NULL, &root_id);
+		//convert_tree_to_array(root, ocl_tree, 0);
+	}
+
+	free(live_copies);
 
 
 	sdk_timer->stopTimer(timer);
@@ -460,9 +824,17 @@ static void run_ocl_path(int iteration, int search_per_wi, size_t preferredLocal
 	sdk_timer->resetTimer(timer);
 	sdk_timer->startTimer(timer);
 	
-	status = clEnqueueWriteBuffer(queue, cl_ocl_tree, CL_TRUE, 0, num_nodes * sizeof(ocl_node), ocl_tree, 0, NULL, NULL); 
+	status = clEnqueueWriteBuffer(queue, cl_ocl_tree, CL_TRUE, 0, tree_size, host_tree, 0, NULL, NULL); 
 	ASSERT_CL(status, "Error clEnqueueWriteBuffer for cl_ocl_tree\n");
 
+	if (ocl_layout == OCL_LAYOUT_SOA) {
+		status = clEnqueueWriteBuffer(queue, cl_soa_left, CL_TRUE, 0, num_nodes * sizeof(int), soa_tree->left, 0, NULL, NULL); 
+		ASSERT_CL(status, "Error clEnqueueWriteBuffer for cl_soa_left\n");
+
+		status = clEnqueueWriteBuffer(queue, cl_soa_right, CL_TRUE, 0, num_nodes * sizeof(int), soa_tree->right, 0, NULL, NULL); 
+		ASSERT_CL(status, "Error clEnqueueWriteBuffer for cl_soa_right\n");
+	}
+
 	sdk_timer->stopTimer(timer);
 	time_spent = sdk_timer->readTimer(timer);
 	printf("Time to send the tree the CPU took %.10f ms\n", 1000 * time_spent);
@@ -470,7 +842,7 @@ static void run_ocl_path(int iteration, int search_per_wi, size_t preferredLocal
 
 	long long int tree_creation_time = 1000  * time_spent;
 
-	if (!verify_ocl_tree(ocl_tree, num_nodes)) {
+	if (ocl_layout == OCL_LAYOUT_BFS && (emitted != live_count || !verify_ocl_tree(ocl_tree, (int)emitted))) {
 		printf("ocl_tree could not be verified.\n");
 		exit(1);
 	}
@@ -481,25 +853,56 @@ static void run_ocl_path(int iteration, int search_per_wi, size_t preferredLocal
 
 	/* Gpu work enqueue */
 	status  = clSetKernelArg(search_kernel, arg++, sizeof(cl_ocl_tree), &cl_ocl_tree);
+	if (ocl_layout == OCL_LAYOUT_SOA) {
+		status |= clSetKernelArg(search_kernel, arg++, sizeof(cl_soa_left), &cl_soa_left);
+		status |= clSetKernelArg(search_kernel, arg++, sizeof(cl_soa_right), &cl_soa_right);
+	}
 	status |= clSetKernelArg(search_kernel, arg++, sizeof(cl_int), &root_id);
+	if (bound_query != BOUND_NONE)
+		status |= clSetKernelArg(search_kernel, arg++, sizeof(cl_int), &bound_query);
 	status |= clSetKernelArg(search_kernel, arg++, sizeof(cl_search_keys), &cl_search_keys);
+	if (range_width)
+		status |= clSetKernelArg(search_kernel, arg++, sizeof(cl_range_hi), &cl_range_hi);
 	status |= clSetKernelArg(search_kernel, arg++, sizeof(cl_int), &num_search_keys);
 	status |= clSetKernelArg(search_kernel, arg++, sizeof(cl_found_nodes_id), &cl_found_nodes_id);
 	ASSERT_CL(status, "Error set search_kernel arg.");
 
+	/* The packed result buffer, argument 6, is set by run_ocl_range_scan */
+	if (range_width) {
+		arg = 0;
+		status  = clSetKernelArg(range_scan_kernel, arg++, sizeof(cl_ocl_tree), &cl_ocl_tree);
+		status |= clSetKernelArg(range_scan_kernel, arg++, sizeof(cl_int), &root_id);
+		status |= clSetKernelArg(range_scan_kernel, arg++, sizeof(cl_search_keys), &cl_search_keys);
+		status |= clSetKernelArg(range_scan_kernel, arg++, sizeof(cl_range_hi), &cl_range_hi);
+		status |= clSetKernelArg(range_scan_kernel, arg++, sizeof(cl_int), &num_search_keys);
+		status |= clSetKernelArg(range_scan_kernel, arg++, sizeof(cl_range_offsets), &cl_range_offsets);
+		ASSERT_CL(status, "Error set range_scan_kernel arg.");
+	}
+
 	printf("Warming up the device..... \n");
 
 	//Warmup run.
 	for (int i = 0; i < 1; i++) {
 		initialize_search_keys(search_keys, num_search_keys);
+		if (order_query == ORDER_SELECT)
+			initialize_select_ranks(search_keys, num_search_keys);
 		status = clEnqueueWriteBuffer(queue, cl_search_keys, CL_FALSE, 0, num_search_keys * sizeof(int), search_keys, 0, NULL, NULL); 
 		ASSERT_CL(status, "Error clEnqueueWriteBuffer for cl_search_keys\n");
 
+		if (range_width) {
+			initialize_range_ends(search_keys, num_search_keys);
+			status = clEnqueueWriteBuffer(queue, cl_range_hi, CL_FALSE, 0, num_search_keys * sizeof(int), range_hi, 0, NULL, NULL); 
+			ASSERT_CL(status, "Error clEnqueueWriteBuffer for cl_range_hi\n");
+		}
+
 		status = clEnqueueNDRangeKernel(queue, search_kernel, 1, NULL, &globalSize, &preferredLocalSize, 0, NULL, NULL);
 		ASSERT_CL(status, "Error when enqueuing search_kernel");
 
 		status = clEnqueueReadBuffer(queue, cl_found_nodes_id, CL_TRUE, 0, num_search_keys * sizeof(int), found_keys, 0, NULL, NULL); 
 		ASSERT_CL(status, "Error clEnqueueWriteBuffer for cl_ocl_tree\n");
+
+		if (range_width)
+			run_ocl_range_scan(queue, (int)num_search_keys, preferredLocalSize);
 	}
 
 	printf("Device warm up done...... \n\nNow running kernel to measure performance..\n");
@@ -518,6 +921,10 @@ static void run_ocl_path(int iteration, int search_per_wi, size_t preferredLocal
 		for (int i = 0; i < iteration; i++) {
 		
 			initialize_search_keys(search_keys, num_search_keys);
+			if (range_width)
+				initialize_range_ends(search_keys, num_search_keys);
+			if (order_query == ORDER_SELECT)
+				initialize_select_ranks(search_keys, num_search_keys);
 
 			sdk_timer->resetTimer(timer);
 			sdk_timer->startTimer(timer);
@@ -525,12 +932,20 @@ static void run_ocl_path(int iteration, int search_per_wi, size_t preferredLocal
 			status = clEnqueueWriteBuffer(queue, cl_search_keys, CL_FALSE, 0, num_search_keys * sizeof(int), search_keys, 0, NULL, NULL); 
 			ASSERT_CL(status, "Error clEnqueueWriteBuffer for cl_search_keys\n");
 
+			if (range_width) {
+				status = clEnqueueWriteBuffer(queue, cl_range_hi, CL_FALSE, 0, num_search_keys * sizeof(int), range_hi, 0, NULL, NULL); 
+				ASSERT_CL(status, "Error clEnqueueWriteBuffer for cl_range_hi\n");
+			}
+
 			status = clEnqueueNDRangeKernel(queue, search_kernel, 1, NULL, &globalSize, &preferredLocalSize, 0, NULL, NULL);
 			ASSERT_CL(status, "Error when enqueuing search_kernel");
 
 			status = clEnqueueReadBuffer(queue, cl_found_nodes_id, CL_TRUE, 0, num_search_keys * sizeof(int), found_keys, 0, NULL, NULL); 
 			ASSERT_CL(status, "Error clEnqueueWriteBuffer for cl_ocl_tree\n");
 
+			if (range_width)
+				run_ocl_range_scan(queue, (int)num_search_keys, preferredLocalSize);
+
 			sdk_timer->stopTimer(timer);
 			search_time += sdk_timer->readTimer(timer);
 
@@ -550,9 +965,19 @@ static void run_ocl_path(int iteration, int search_per_wi, size_t preferredLocal
 
 		found_count = 0;
 
-		for (int i = 0; i < num_search_keys; i++) {
-			if (found_keys[i])
-				found_count++;
+		/* The range scan returns the node indices of all ranges. The
+		 * device layouts hold only the live nodes, so the count matches
+		 * the cpu scan, which skips the deleted ones */
+		if (range_width) {
+			found_count = ocl_range_total;
+		}
+		else {
+			/* The kernels write -1 for a missing key. Index 0 is the
+			 * root of the BFS layouts and is a hit */
+			for (int i = 0; i < keys_searched(num_search_keys); i++) {
+				if (found_keys[i] != -1)
+					found_count++;
+			}
 		}
 
 		printf ("Total keys found: %d\n\n", found_count);
@@ -560,9 +985,33 @@ static void run_ocl_path(int iteration, int search_per_wi, size_t preferredLocal
 	}while (get_next_search_per_wi(&search_per_wi));
 
 
-	if (ocl_tree)
+	if (ocl_tree && !arena)
 		free(ocl_tree);
 
+	eytzinger_release(eyt_tree);
+
+	if (compact_tree)
+		free(compact_tree);
+
+	if (cl_range_hi)
+		clReleaseMemObject(cl_range_hi);
+
+	if (range_scan_kernel) {
+		clReleaseMemObject(cl_range_offsets);
+		if (cl_range_ids)
+			clReleaseMemObject(cl_range_ids);
+		clReleaseKernel(range_scan_kernel);
+		free(ocl_range_ids);
+	}
+
+	free_soa_tree(soa_tree);
+
+	if (cl_soa_left)
+		clReleaseMemObject(cl_soa_left);
+
+	if (cl_soa_right)
+		clReleaseMemObject(cl_soa_right);
+
 	clReleaseKernel(search_kernel);
 	clReleaseCommandQueue(queue);
 	clReleaseProgram(program);
@@ -657,28 +1106,27 @@ static void run_hsa_path(int iteration, int search_per_wi, size_t preferredLocal
 		globalSize = (size_t)(num_search_keys / search_per_wi); 
 		preferredLocalSize = 256; //64 or 256 gave worse performance! May be because of the diveregnce in the kernel.
 
-		sdk_timer->resetTimer(timer);
-		sdk_timer->startTimer(timer);
-
+		time_spent = 0;
 
+		/* Only the kernel is timed, the keys are generated before */
 		for (i = 0; i < iteration; i++) {
-			sdk_timer->stopTimer(timer);
 			initialize_search_keys(search_keys, num_search_keys);
+
+			sdk_timer->resetTimer(timer);
 			sdk_timer->startTimer(timer);
 			status = clEnqueueNDRangeKernel(queue, search_kernel, 1, NULL, &globalSize, &preferredLocalSize, 0, NULL, &kernel_event);
 			ASSERT_CL(status, "Error when enqueuing search_kernel");
 			clWaitForEvents(1, &kernel_event);
 			clReleaseEvent(kernel_event);
+			sdk_timer->stopTimer(timer);
+			time_spent += sdk_timer->readTimer(timer);
 		}
 
-		sdk_timer->stopTimer(timer);
-
-		time_spent = sdk_timer->readTimer(timer);
 		printf("Avg time to search %d nodes on the GPU= %.10f ms\n", num_search_keys, 1000 * (time_spent / iteration));
 
 		found_count = 0;
 
-		for (i = 0; i < num_search_keys; i++) {
+		for (i = 0; i < keys_searched(num_search_keys); i++) {
 			if (found_key_nodes[i])
 				found_count++;
 		}
@@ -701,6 +1149,128 @@ static void run_hsa_path(int iteration, int search_per_wi, size_t preferredLocal
 }
 
 
+/* With -d or -u, deletes a slice of the live keys on a thread of its own
+ * while the cpu threads search the same keys. The search walks the pointer
+ * tree, the other layouts are snapshots. The keys are then inserted again,
+ * into the nodes the deletes reclaimed first, while a thread of its own
+ * searches them. Every node found must hold its key and the tree must hold
+ * the nodes left. */
+static void run_concurrent_updates(int num_thread)
+{
+	node **live, **found;
+	node *search_root = root;
+	int *keys;
+	int count, num_keys, deleted = 0, wrong = 0;
+	std::atomic<int> inserting(1);
+	long long lookups = 0;
+
+	live = collect_live(root, &count);
+	num_keys = (int)((long long)count * (delete_percent ? delete_percent : insert_percent) / 100);
+	if (!num_keys) {
+		free(live);
+		return;
+	}
+
+	if ((keys = (int *)malloc(num_keys * sizeof(int))) == NULL ||
+		(found = (node **)malloc(num_keys * sizeof(node *))) == NULL) {
+		printf("Error allocating memory for the concurrent updates.\n");
+		exit(1);
+	}
+	for (int i = 0; i < num_keys; i++)
+		keys[i] = live[(long long)i * count / num_keys]->value;
+	free(live);
+
+	set_search_engine(SEARCH_ENGINE_POINTER, 0);
+	set_top_levels(0);
+	prepare_search_engine(search_root);
+
+	sdk_timer->resetTimer(timer);
+	sdk_timer->startTimer(timer);
+	std::thread writer([&] { deleted = delete_keys(&root, keys, num_keys); });
+	multithreaded_search(search_root, keys, num_keys, num_thread, found);
+	writer.join();
+	sdk_timer->stopTimer(timer);
+
+	for (int i = 0; i < num_keys; i++) {
+		if (found[i] && found[i]->value != keys[i])
+			wrong++;
+	}
+	printf("Time to search %d keys while they are deleted = %.10f ms, %d deleted, %d wrong nodes found\n",
+		num_keys, 1000 * sdk_timer->readTimer(timer), deleted, wrong);
+	epoch_print_stats();
+
+	if (wrong || count_node(root) != count - deleted || !isBST(root)) {
+		printf("error in the concurrent delete.\n");
+		exit(1);
+	}
+
+	if ((update_nodes = (node *)calloc(num_keys, sizeof(node))) == NULL) {
+		printf("Error allocating memory for the concurrent updates.\n");
+		exit(1);
+	}
+	for (int i = 0; i < num_keys; i++)
+		update_nodes[i].value = keys[i];
+
+	std::thread reader([&] {
+		node *tmp;
+
+		while (inserting.load()) {
+			epoch_enter();
+			for (int i = 0; i < num_keys; i++) {
+				tmp = search_node(bst_load_ptr(&root), keys[i]);
+				if (tmp && tmp->value != keys[i])
+					wrong++;
+			}
+			epoch_exit();
+			lookups += num_keys;
+		}
+	});
+
+	sdk_timer->resetTimer(timer);
+	sdk_timer->startTimer(timer);
+	multithreaded_insert(&root, update_nodes, num_keys, num_thread);
+	sdk_timer->stopTimer(timer);
+	inserting.store(0);
+	reader.join();
+	printf("Time to insert the %d keys again = %.10f ms, %lld lookups meanwhile, %d wrong nodes found\n",
+		num_keys, 1000 * sdk_timer->readTimer(timer), lookups, wrong);
+	epoch_print_stats();
+
+	if (wrong || count_node(root) != count - deleted + num_keys || !isBST(root)) {
+		printf("error inserting the deleted keys again.\n");
+		exit(1);
+	}
+
+	free(keys);
+	free(found);
+}
+
+static void print_usage(const char *prog)
+{
+	printf("Usage: %s [-n (BST tree size) in million nodes][-i (search kernel iteartion)][-w (search per work item)][-t (num_cpu_threads)][-g (work group size)][-o (Use OpenCL stacl]"
+		"[-e (cpu search engine)][-a (interleaved lookups per cpu thread)][-l (OpenCL tree layout)][-s (1: sort the cpu search batch, 2: sort the search keys)]"
+		"[-b (1: bulk load a balanced tree, 2: AVL insert, 3: AVL sorted batch insert)][-u (percent of nodes inserted concurrently)][-d (percent of nodes deleted)]"
+		"[-q (nearest key query)][-r (width of the range queries)][-k (1: rank queries, 2: select queries)]"
+		"[-x (32, 64 or 128 bit keys on the templated tree)]"
+		"[-R (search key distribution)][-S (seed)][-z (zipf theta)][-h (percent of search keys in the tree)]"
+		"[-c (hot key cache entries per cpu thread, 0: off)][-T (tree levels replicated for the pointer tree engines)]"
+		"[-H (node arena pages, 0: 4K, 1: 2MB, 2: 1GB)][-N (1: NUMA local replicas of the BFS arrays, 2: remote replicas)]\n", prog);
+	printf("  cpu search engines (-e):\n");
+	for (int e = 0; e < SEARCH_ENGINE_COUNT; e++)
+		printf("    %d: %s\n", e, search_engine_name(e));
+	printf("  OpenCL tree layouts (-l):\n");
+	printf("    %d: BFS ocl_node array\n", OCL_LAYOUT_BFS);
+	printf("    %d: eytzinger key array\n", OCL_LAYOUT_EYTZINGER);
+	printf("    %d: BFS ocl_compact_node array\n", OCL_LAYOUT_COMPACT);
+	printf("    %d: BFS key/left/right arrays (SoA)\n", OCL_LAYOUT_SOA);
+	printf("  search key distributions (-R):\n");
+	for (int d = 0; d < KEY_DIST_COUNT; d++)
+		printf("    %d: %s\n", d, key_dist_name(d));
+	printf("  nearest key queries (-q):\n");
+	for (int q = 0; q < BOUND_COUNT; q++)
+		printf("    %d: %s\n", q, bound_query_name(q));
+}
+
 int main(int argc, char* argv[])
 {
 	cl_int status = 0;
@@ -708,9 +1278,18 @@ int main(int argc, char* argv[])
 	int iteration = 1;
 	int search_per_wi = 1;
 	int num_cpu_threads = 4;
+	int cpu_engine = SEARCH_ENGINE_POINTER;
+	int interleave_group = 0;
+	int sort_mode = 0;
+	int cache_entries = 0;
+	int top_levels = 0;
+	int numa_mode = NUMA_REPLICA_OFF;
+	int numa_round = 0;		// the replica timing alternates which mode runs first
+	int sorted_batch;
 	size_t preferredLocalSize = 256;
 	int i;
 	
+	workload_init(&search_load);
 	
 	// basic arg parsing
 	while (argv[1] && argv[1][0] == '-') {
@@ -732,9 +1311,122 @@ int main(int argc, char* argv[])
 		} else if (strcmp(argv[1], "-o") == 0) {
 			argv++; argc--;
 			use_ocl = atoi(argv[1]);
+		} else if (strcmp(argv[1], "-e") == 0) {
+			argv++; argc--;
+			cpu_engine = atoi(argv[1]);
+		} else if (strcmp(argv[1], "-a") == 0) {
+			argv++; argc--;
+			interleave_group = atoi(argv[1]);
+		} else if (strcmp(argv[1], "-l") == 0) {
+			argv++; argc--;
+			ocl_layout = atoi(argv[1]);
+		} else if (strcmp(argv[1], "-s") == 0) {
+			argv++; argc--;
+			sort_mode = atoi(argv[1]);
+		} else if (strcmp(argv[1], "-b") == 0) {
+			argv++; argc--;
+			build_mode = atoi(argv[1]);
+		} else if (strcmp(argv[1], "-d") == 0) {
+			argv++; argc--;
+			delete_percent = atoi(argv[1]);
+			if (delete_percent < 0 || delete_percent > 100) {
+				printf("Delete percent must be between 0 and 100.\n");
+				exit(1);
+			}
+		} else if (strcmp(argv[1], "-q") == 0) {
+			argv++; argc--;
+			bound_query = atoi(argv[1]);
+			if (bound_query < 0 || bound_query >= BOUND_COUNT) {
+				printf("Unknown nearest key query %d.\n", bound_query);
+				exit(1);
+			}
+		} else if (strcmp(argv[1], "-k") == 0) {
+			argv++; argc--;
+			order_query = atoi(argv[1]);
+			if (order_query < ORDER_NONE || order_query > ORDER_SELECT) {
+				printf("Unknown order statistic query %d.\n", order_query);
+				exit(1);
+			}
+			if (order_query != ORDER_NONE && !order_stat_available()) {
+				printf("Rank and select need a build with BST_SUBTREE_SIZE.\n");
+				exit(1);
+			}
+		} else if (strcmp(argv[1], "-R") == 0) {
+			argv++; argc--;
+			search_load.dist = atoi(argv[1]);
+			if (search_load.dist < 0 || search_load.dist >= KEY_DIST_COUNT) {
+				printf("Unknown search key distribution %d.\n", search_load.dist);
+				exit(1);
+			}
+		} else if (strcmp(argv[1], "-S") == 0) {
+			argv++; argc--;
+			search_load.seed = strtoull(argv[1], NULL, 0);
+		} else if (strcmp(argv[1], "-z") == 0) {
+			argv++; argc--;
+			search_load.zipf_theta = atof(argv[1]);
+			if (search_load.zipf_theta <= 0 || search_load.zipf_theta >= 1) {
+				printf("Zipf theta must be between 0 and 1.\n");
+				exit(1);
+			}
+		} else if (strcmp(argv[1], "-h") == 0) {
+			argv++; argc--;
+			search_load.hit_ratio = atoi(argv[1]) / 100.0;
+			if (search_load.hit_ratio < 0 || search_load.hit_ratio > 1) {
+				printf("Hit percent must be between 0 and 100.\n");
+				exit(1);
+			}
+		} else if (strcmp(argv[1], "-c") == 0) {
+			argv++; argc--;
+			cache_entries = atoi(argv[1]);
+			if (cache_entries < 0) {
+				printf("Hot key cache entries must not be negative.\n");
+				exit(1);
+			}
+		} else if (strcmp(argv[1], "-T") == 0) {
+			argv++; argc--;
+			top_levels = atoi(argv[1]);
+			if (top_levels < 0) {
+				printf("Replicated levels must not be negative.\n");
+				exit(1);
+			}
+		} else if (strcmp(argv[1], "-H") == 0) {
+			argv++; argc--;
+			arena_pages = atoi(argv[1]);
+			if (arena_pages < 0 || arena_pages >= ARENA_PAGES_COUNT) {
+				printf("Unknown arena page size %d.\n", arena_pages);
+				exit(1);
+			}
+		} else if (strcmp(argv[1], "-N") == 0) {
+			argv++; argc--;
+			numa_mode = atoi(argv[1]);
+			if (numa_mode < NUMA_REPLICA_OFF || numa_mode > NUMA_REPLICA_REMOTE) {
+				printf("Unknown NUMA replica mode %d.\n", numa_mode);
+				exit(1);
+			}
+		} else if (strcmp(argv[1], "-x") == 0) {
+			argv++; argc--;
+			key_bits = atoi(argv[1]);
+			if (key_bits != 32 && key_bits != 64 && key_bits != 128) {
+				printf("Key width must be 32, 64 or 128 bits.\n");
+				exit(1);
+			}
+		} else if (strcmp(argv[1], "-r") == 0) {
+			argv++; argc--;
+			range_width = atoi(argv[1]);
+			if (range_width < 0) {
+				printf("Range width must not be negative.\n");
+				exit(1);
+			}
+		} else if (strcmp(argv[1], "-u") == 0) {
+			argv++; argc--;
+			insert_percent = atoi(argv[1]);
+			if (insert_percent < 0 || insert_percent > 100) {
+				printf("Insert percent must be between 0 and 100.\n");
+				exit(1);
+			}
 		} else {
 			fprintf(stderr, "Illegal option %s ignored\n", argv[1]);
-			printf("Usage: %s [-n (BST tree size) in million nodes][-i (search kernel iteartion)][-w (search per work item)][-t (num_cpu_threads)][-g (work group size)][-o (Use OpenCL stacl]\n", argv[0]);
+			print_usage(argv[0]);
 			exit(1);
 		}
 		argv++;
@@ -742,7 +1434,7 @@ int main(int argc, char* argv[])
 	}
 
 	if (argc > 1) {
-		printf("Usage: %s [-n (BST tree size) in million nodes][-i (search kernel iteartion)][-w (search per work item)][-t (num_cpu_threads)][-g (work group size)][-o (Use OpenCL stacl]\n", argv[0]);
+		print_usage(argv[0]);
 		exit(1);
 	}
 
@@ -751,8 +1443,48 @@ int main(int argc, char* argv[])
 
 	num_search_keys = (int)(num_nodes * 0.25); //Searching 25% of the data
 
+	cpu_engine = set_search_engine(cpu_engine, interleave_group);
+	top_levels = set_top_levels(top_levels);
+	numa_mode = set_numa_replicas(numa_mode);
+
+	/* The templated tree has its own keys. The Orca stack searches it on
+	 * the device as well, the HSA stack has no keyed kernel */
+	if (key_bits) {
+		run_keyed_benchmark(key_bits, (int)num_nodes, (int)num_search_keys, num_cpu_threads, iteration, search_load.seed);
+		if (use_ocl)
+			run_ocl_path(iteration, search_per_wi, preferredLocalSize);
+		thread_pool_release();
+		return 0;
+	}
+
+	sorted_batch = (sort_mode == 1);
+	sort_keys = (sort_mode == 2);
+
+	/* The keys are generated on the cpu threads, as are the bulk load, the
+	 * concurrent insert and the sort of the keys of the OpenCL runs */
+	thread_pool_init(num_cpu_threads);
+
+	printf("Search keys: %s distribution, seed %llu\n", key_dist_name(search_load.dist), (unsigned long long)search_load.seed);
+
+	if (top_levels)
+		printf("The pointer tree engines descend a replica of the top %d levels first\n", top_levels);
+
+	if (numa_mode != NUMA_REPLICA_OFF)
+		printf("The BFS array engines read %s, %d NUMA node%s\n", numa_replica_name(numa_mode),
+			numa_node_count(), (numa_node_count() > 1) ? "s" : "");
+
+	/* multithreaded_search looks the keys up in the cache of its thread
+	 * before the engine walks the tree */
+	if (hot_cache_configure(cache_entries))
+		printf("Hot key cache of %d entries per cpu thread\n", hot_cache_entries());
+
+	if (arena_pages >= 0)
+		printf("Nodes are allocated from an arena on %s\n", arena_pages_name(arena_pages));
+
 	if (!use_ocl) {
 		printf(" Using HSA stack... \n");
+		if (arena_pages >= 0)
+			printf("The HSA stack shares the nodes with clSVMAlloc, the arena is only used by the Orca stack.\n");
 		run_hsa_path(iteration, search_per_wi, preferredLocalSize);
 	}
 	else {
@@ -760,30 +1492,72 @@ int main(int argc, char* argv[])
 		run_ocl_path(iteration, search_per_wi, preferredLocalSize);
 	}
 
+	/* Build the layout searched by the cpu engine before timing */
+	sdk_timer->resetTimer(timer);
+	sdk_timer->startTimer(timer);
+	prepare_search_engine(root);
+	sdk_timer->stopTimer(timer);
+	time_spent = sdk_timer->readTimer(timer);
+	printf("Time to build the %s layout on the CPU = %.10f ms\n", search_engine_name(cpu_engine), 1000 * time_spent);
+
+	if (range_width && (range_offsets = (int *)malloc((num_search_keys + 1) * sizeof(int))) == NULL) {
+		printf("Error allocating memory for range offsets.\n");
+		exit(1);
+	}
+
+	if (order_query == ORDER_RANK && (order_ranks = (int *)malloc(num_search_keys * sizeof(int))) == NULL) {
+		printf("Error allocating memory for ranks.\n");
+		exit(1);
+	}
+
 	do {
 
-		sdk_timer->resetTimer(timer);
-		sdk_timer->startTimer(timer);
 		/********* Start CPU performance measurment. *************/
 		memset(found_key_nodes, 0, num_search_keys * sizeof(node *));
+		thread_pool_reset_stats();
+		sorted_search_reset_stats();
+		hot_cache_reset_stats();
+		time_spent = 0;
 
+		/* Only the search is timed, the keys are generated before */
 		for (i = 0; i < iteration; i++) {
-			sdk_timer->stopTimer(timer);
 			initialize_search_keys(search_keys, num_search_keys);
+			if (range_width)
+				initialize_range_ends(search_keys, num_search_keys);
+			if (order_query == ORDER_SELECT)
+				initialize_select_ranks(search_keys, num_search_keys);
+
+			sdk_timer->resetTimer(timer);
 			sdk_timer->startTimer(timer);
 
-			multithreaded_search(root, search_keys, num_search_keys, num_cpu_threads, found_key_nodes);
+			if (order_query == ORDER_RANK)
+				multithreaded_rank(root, search_keys, num_search_keys, num_cpu_threads, order_ranks);
+			else if (order_query == ORDER_SELECT)
+				multithreaded_select(root, search_keys, num_search_keys, num_cpu_threads, found_key_nodes);
+			else if (range_width)
+				multithreaded_range_scan(root, search_keys, range_hi, num_search_keys, num_cpu_threads, range_offsets);
+			else if (bound_query != BOUND_NONE)
+				multithreaded_bound_search(root, search_keys, num_search_keys, num_cpu_threads, bound_query, found_key_nodes);
+			else if (sorted_batch)
+				sorted_search(root, search_keys, num_search_keys, num_cpu_threads, found_key_nodes);
+			else
+				multithreaded_search(root, search_keys, num_search_keys, num_cpu_threads, found_key_nodes);
 			/* 
 			//Single threaded CPU search.
 			for (int j = 0; j < num_search_keys; j++) {
 			found_keys[j] = search_node(root, search_keys[j]);
 			}
 			*/
+			sdk_timer->stopTimer(timer);
+			time_spent += sdk_timer->readTimer(timer);
 		}
 
-		sdk_timer->stopTimer(timer);
-		time_spent = sdk_timer->readTimer(timer);
-		printf("Avg Time to search %d nodes on the CPU = %.10f ms\n", num_search_keys, 1000 * (time_spent / iteration)); 
+		printf("Avg Time to search %d nodes on the CPU (%s) = %.10f ms\n", num_search_keys,
+			(order_query == ORDER_RANK) ? "rank" :
+			(order_query == ORDER_SELECT) ? "select" :
+			range_width ? "range scan" :
+			(bound_query != BOUND_NONE) ? bound_query_name(bound_query) :
+			sorted_batch ? "sorted batch" : search_engine_name(cpu_engine), 1000 * (time_spent / iteration)); 
 
 		found_count = 0;
 		for (i = 0; i < num_search_keys; i++) {
@@ -792,11 +1566,78 @@ int main(int argc, char* argv[])
 			}
 		}
 
+		thread_pool_print_stats();
+		hot_cache_print_stats();
+		if (top_levels && order_query == ORDER_NONE && !range_width && bound_query == BOUND_NONE && !sorted_batch)
+			print_top_levels_stats(root, search_keys, num_search_keys);
+
+		/* A range scan finds all keys of the ranges, a rank query
+		 * always has an answer */
+		if (order_query == ORDER_RANK)
+			found_count = num_search_keys;
+		else if (range_width)
+			found_count = range_offsets[num_search_keys];
+
+		/* Search the last batch again in arrival order to see whether
+		 * the sort pays for itself */
+		if (sorted_batch && bound_query == BOUND_NONE && !range_width && order_query == ORDER_NONE) {
+			sdk_timer->resetTimer(timer);
+			sdk_timer->startTimer(timer);
+			multithreaded_search(root, search_keys, num_search_keys, num_cpu_threads, found_key_nodes);
+			sdk_timer->stopTimer(timer);
+			time_spent = sdk_timer->readTimer(timer);
+			printf("Unsorted search uses the %s engine\n", search_engine_name(cpu_engine));
+			sorted_search_print_stats(1000 * time_spent);
+		}
+
+		/* Search a fresh batch on the local and on the remote replicas to
+		 * compare the reads. Each mode gets its own batch and the mode that
+		 * runs first alternates, so neither reads keys the other warmed.
+		 * Only the BFS array engines read the replicas, and the hot key
+		 * cache is off so that both runs walk the arrays */
+		if (numa_mode != NUMA_REPLICA_OFF && !sorted_batch && bound_query == BOUND_NONE && !range_width && order_query == ORDER_NONE &&
+			(cpu_engine == SEARCH_ENGINE_BFS_ARRAY || cpu_engine == SEARCH_ENGINE_COMPACT_ARRAY || cpu_engine == SEARCH_ENGINE_SOA_ARRAY)) {
+			int replica_modes[2] = { NUMA_REPLICA_LOCAL, NUMA_REPLICA_REMOTE };
+			int entries = hot_cache_entries();
+
+			hot_cache_configure(0);
+
+			for (int m = numa_round & 1; m < (numa_round & 1) + 2; m++) {
+				set_numa_replicas(replica_modes[m & 1]);
+				initialize_search_keys(search_keys, num_search_keys);
+				sdk_timer->resetTimer(timer);
+				sdk_timer->startTimer(timer);
+				multithreaded_search(root, search_keys, num_search_keys, num_cpu_threads, found_key_nodes);
+				sdk_timer->stopTimer(timer);
+				printf("Time to search a fresh batch with %s = %.10f ms\n", numa_replica_name(replica_modes[m & 1]), 1000 * sdk_timer->readTimer(timer));
+			}
+
+			numa_round++;
+
+			set_numa_replicas(numa_mode);
+			hot_cache_configure(entries);
+		}
+
 		printf ("Total keys found: %d\n\n", found_count);
 	}while (get_next_num_cpu_threads(&num_cpu_threads));
 
+	if (delete_percent || insert_percent)
+		run_concurrent_updates(num_cpu_threads);
 
 	/* cleanup */
+	release_search_engine();
+	hot_cache_release();
+	sorted_search_release();
+	range_search_release();
+	radix_sort_release();
+	free(range_hi);
+	free(range_offsets);
+	free(order_ranks);
+	free(tree_keys);
+	free(update_nodes);
+	epoch_release();
+	thread_pool_release();
+
 	if (!use_ocl) {
 		dF.clSVMFree(context, data);
 		dF.clSVMFree(context, found_key_nodes);
@@ -804,7 +1645,9 @@ int main(int argc, char* argv[])
 	}
 	else {
 	
-		if (data)
+		if (arena)
+			arena_release(arena);
+		else if (data)
 			free(data);
 
 		if (found_keys)
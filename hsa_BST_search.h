@@ -7,11 +7,17 @@
 #define __global 
 #endif
 
+#include "ocl_BST_search.h"
+
 typedef struct bin_tree
 {
     int value;                  // Value at a node
 	int height; 
 	int found;
+	int deleted;				// Set once the key is deleted, the node may still route searches
+#ifdef BST_SUBTREE_SIZE
+	int size;					// Live keys in the subtree, for rank and select
+#endif
     __global struct bin_tree *left;      // Pointer to the left node
     __global struct bin_tree *right;     // Pointer to the right node
 	__global struct bin_tree *parent;
@@ -0,0 +1,109 @@
+/*******************************************************************************
+Copyright 2013 Advanced Micro Devices, Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1 Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+2 Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+/**
+********************************************************************************
+* @file <interleaved_search.cpp>
+*
+* @brief This file contains the interleaved (AMAC) batch search on the cpu.
+* A thread keeps a group of independent traversals in flight and advances
+* them round robin. The next child of a traversal is prefetched before
+* switching to the next one, so the cache misses of the group overlap
+* instead of being paid one after the other.
+*
+********************************************************************************
+*/
+
+#include "cpu_BST.h"
+#include "interleaved_search.h"
+
+typedef struct _amac_state
+{
+	node *cur;
+	int key;
+	int idx;	// Index of the key in the batch, -1 if the slot is empty
+} amac_state;
+
+void interleaved_search(node *root, const top_levels *top, int *keys, node **found_keys, int begin, int end, int group_size)
+{
+	amac_state state[MAX_INTERLEAVE_GROUP];
+	int next = begin;
+	int active = 0;
+	node *tmp_node;
+
+	if (group_size < 1)
+		group_size = 1;
+	else if (group_size > MAX_INTERLEAVE_GROUP)
+		group_size = MAX_INTERLEAVE_GROUP;
+
+	for (int g = 0; g < group_size; g++) {
+		if (next < end) {
+			state[g].key = keys[next];
+			state[g].cur = top_levels_start(top, root, state[g].key);
+			state[g].idx = next++;
+			active++;
+		}
+		else {
+			state[g].idx = -1;
+		}
+	}
+
+	while (active) {
+		for (int g = 0; g < group_size; g++) {
+			amac_state *s = &state[g];
+			if (s->idx < 0)
+				continue;
+
+			tmp_node = s->cur;
+
+			/* Traversal done, start the next key from the root which
+			 * stays in the cache, or below the replicated top levels
+			 * of the tree. */
+			if (!tmp_node || tmp_node->value == s->key) {
+				if (tmp_node && bst_load_int(&tmp_node->deleted))
+					tmp_node = search_deleted_equal(tmp_node, s->key);
+				found_keys[s->idx] = tmp_node;
+
+				if (next < end) {
+					s->key = keys[next];
+					s->cur = top_levels_start(top, root, s->key);
+					s->idx = next++;
+					if (top && s->cur)
+						BST_PREFETCH(s->cur);
+				}
+				else {
+					s->idx = -1;
+					active--;
+				}
+				continue;
+			}
+
+			tmp_node = bst_load_ptr((s->key < tmp_node->value) ? &tmp_node->left : &tmp_node->right);
+			if (tmp_node)
+				BST_PREFETCH(tmp_node);
+			s->cur = tmp_node;
+		}
+	}
+}
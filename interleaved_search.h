@@ -0,0 +1,12 @@
+#ifndef INTERLEAVED_SEARCH_H_
+#define INTERLEAVED_SEARCH_H_
+
+#include "hsa_BST_search.h"
+#include "top_levels.h"
+
+/* Largest number of traversals kept in flight by one thread. */
+#define MAX_INTERLEAVE_GROUP 64
+
+void interleaved_search(node *root, const top_levels *top, int *keys, node **found_keys, int begin, int end, int group_size);
+
+#endif
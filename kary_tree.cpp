@@ -0,0 +1,273 @@
+/*******************************************************************************
+Copyright 2013 Advanced Micro Devices, Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1 Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+2 Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+/**
+********************************************************************************
+* @file <kary_tree.cpp>
+*
+* @brief This file contains the static SIMD k-ary search tree. Each node is
+* one cache line of sorted keys and is searched with a single AVX-512 or
+* two AVX2 compares plus movemask/popcount. The instruction set is picked
+* at run time from what the cpu supports.
+*
+********************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include "cpu_BST.h"
+#include "kary_tree.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define KARY_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#define KARY_TARGET(isa)
+#define kary_popcount(x) __popcnt(x)
+#else
+#define KARY_TARGET(isa) __attribute__((target(isa)))
+#define kary_popcount(x) __builtin_popcount(x)
+#endif
+
+#define KARY_ISA_SCALAR	0
+#define KARY_ISA_AVX2	1
+#define KARY_ISA_AVX512	2
+
+static int kary_isa = -1;
+
+static inline long long child_block(long long k, int i)
+{
+	return k * (KARY_NODE_KEYS + 1) + i + 1;
+}
+
+/* In-order walk of the k-ary tree, filling each key slot with the next
+ * sorted key. The recursion depth is log17(n). */
+static void fill_blocks(kary_tree *tree, node **sorted, int *next, long long k)
+{
+	if (k >= tree->num_blocks)
+		return;
+
+	for (int i = 0; i < KARY_NODE_KEYS; i++) {
+		long long slot = k * KARY_NODE_KEYS + i;
+
+		fill_blocks(tree, sorted, next, child_block(k, i));
+		if (*next < tree->num_nodes) {
+			tree->keys[slot] = sorted[*next]->value;
+			tree->nodes[slot] = sorted[*next];
+			(*next)++;
+		}
+		else {
+			tree->keys[slot] = INT_MAX;
+			tree->nodes[slot] = NULL;
+		}
+	}
+
+	fill_blocks(tree, sorted, next, child_block(k, KARY_NODE_KEYS));
+}
+
+static int detect_isa(void)
+{
+#ifdef KARY_X86
+#if defined(_MSC_VER)
+	int regs[4];
+	int avx2 = 0, avx512 = 0;
+
+	__cpuid(regs, 1);
+	/* OSXSAVE and AVX, then check the OS saves the ymm/zmm state */
+	if ((regs[2] & (1 << 27)) && (regs[2] & (1 << 28))) {
+		unsigned long long xcr0 = _xgetbv(0);
+		__cpuidex(regs, 7, 0);
+		avx2 = ((xcr0 & 0x6) == 0x6) && (regs[1] & (1 << 5));
+		avx512 = ((xcr0 & 0xe6) == 0xe6) && (regs[1] & (1 << 16));
+	}
+
+	if (avx512)
+		return KARY_ISA_AVX512;
+	if (avx2)
+		return KARY_ISA_AVX2;
+#else
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		return KARY_ISA_AVX512;
+	if (__builtin_cpu_supports("avx2"))
+		return KARY_ISA_AVX2;
+#endif
+#endif
+	return KARY_ISA_SCALAR;
+}
+
+const char *kary_isa_name(void)
+{
+	if (kary_isa < 0)
+		kary_isa = detect_isa();
+
+	switch (kary_isa) {
+	case KARY_ISA_AVX512: return "AVX-512";
+	case KARY_ISA_AVX2: return "AVX2";
+	default: return "scalar";
+	}
+}
+
+kary_tree *kary_build(node **sorted, int num_nodes)
+{
+	kary_tree *tree;
+	int next = 0;
+
+	if (kary_isa < 0)
+		kary_isa = detect_isa();
+
+	if ((tree = (kary_tree *)malloc(sizeof(kary_tree))) == NULL) {
+		printf("Error allocating memory for k-ary tree.\n");
+		exit(1);
+	}
+
+	tree->num_nodes = num_nodes;
+	tree->num_blocks = (num_nodes + KARY_NODE_KEYS - 1) / KARY_NODE_KEYS;
+	if (tree->num_blocks == 0)
+		tree->num_blocks = 1;
+
+	size_t slots = (size_t)tree->num_blocks * KARY_NODE_KEYS;
+	if ((tree->keys = (int *)bst_aligned_alloc(64, slots * sizeof(int))) == NULL) {
+		printf("Error allocating memory for k-ary tree keys.\n");
+		exit(1);
+	}
+
+	if ((tree->nodes = (node **)malloc(slots * sizeof(node *))) == NULL) {
+		printf("Error allocating memory for k-ary tree nodes.\n");
+		exit(1);
+	}
+
+	fill_blocks(tree, sorted, &next, 0);
+
+	return tree;
+}
+
+void kary_release(kary_tree *tree)
+{
+	if (!tree)
+		return;
+
+	bst_aligned_free(tree->keys);
+	free(tree->nodes);
+	free(tree);
+}
+
+/* Number of keys in the node smaller than key, i.e. the child to descend. */
+static inline int rank_scalar(const int *block, int key)
+{
+	int count = 0;
+
+	for (int i = 0; i < KARY_NODE_KEYS; i++)
+		count += (block[i] < key);
+
+	return count;
+}
+
+#ifdef KARY_X86
+KARY_TARGET("avx2,popcnt")
+static inline int rank_avx2(const int *block, int key)
+{
+	__m256i k = _mm256_set1_epi32(key);
+	__m256i lo = _mm256_load_si256((const __m256i *)block);
+	__m256i hi = _mm256_load_si256((const __m256i *)(block + 8));
+	unsigned int mask_lo = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(k, lo)));
+	unsigned int mask_hi = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(k, hi)));
+
+	return kary_popcount(mask_lo | (mask_hi << 8));
+}
+
+KARY_TARGET("avx512f,popcnt")
+static inline int rank_avx512(const int *block, int key)
+{
+	__m512i k = _mm512_set1_epi32(key);
+	__m512i keys = _mm512_load_si512((const void *)block);
+
+	return kary_popcount((unsigned int)_mm512_cmpgt_epi32_mask(k, keys));
+}
+#endif
+
+/* One search loop per instruction set so the rank function is inlined and
+ * the dispatch costs one branch per batch, not one call per node. The
+ * lower bound slot is tracked on the way down and checked at the end. */
+#define KARY_SEARCH_LOOP(RANK)												\
+	for (int i = begin; i < end; i++) {										\
+		int key = keys[i];													\
+		long long k = 0, res = -1;											\
+		while (k < tree->num_blocks) {										\
+			int r = RANK(tree->keys + k * KARY_NODE_KEYS, key);				\
+			if (r < KARY_NODE_KEYS)											\
+				res = k * KARY_NODE_KEYS + r;								\
+			k = child_block(k, r);											\
+		}																	\
+		found_keys[i] = (res >= 0 && tree->keys[res] == key) ? tree->nodes[res] : NULL; \
+	}
+
+static void search_batch_scalar(kary_tree *tree, int *keys, node **found_keys, int begin, int end)
+{
+	KARY_SEARCH_LOOP(rank_scalar)
+}
+
+#ifdef KARY_X86
+KARY_TARGET("avx2,popcnt")
+static void search_batch_avx2(kary_tree *tree, int *keys, node **found_keys, int begin, int end)
+{
+	KARY_SEARCH_LOOP(rank_avx2)
+}
+
+KARY_TARGET("avx512f,popcnt")
+static void search_batch_avx512(kary_tree *tree, int *keys, node **found_keys, int begin, int end)
+{
+	KARY_SEARCH_LOOP(rank_avx512)
+}
+#endif
+
+void kary_search_batch(kary_tree *tree, int *keys, node **found_keys, int begin, int end)
+{
+	switch (kary_isa) {
+#ifdef KARY_X86
+	case KARY_ISA_AVX512:
+		search_batch_avx512(tree, keys, found_keys, begin, end);
+		break;
+	case KARY_ISA_AVX2:
+		search_batch_avx2(tree, keys, found_keys, begin, end);
+		break;
+#endif
+	default:
+		search_batch_scalar(tree, keys, found_keys, begin, end);
+		break;
+	}
+}
+
+node *kary_search(kary_tree *tree, int key)
+{
+	node *found;
+
+	kary_search_batch(tree, &key, &found, 0, 1);
+
+	return found;
+}
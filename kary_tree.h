@@ -0,0 +1,28 @@
+#ifndef KARY_TREE_H_
+#define KARY_TREE_H_
+
+#include "hsa_BST_search.h"
+
+/* Keys per node. 16 ints fill one 64 byte cache line. */
+#define KARY_NODE_KEYS 16
+
+/* Static k-ary search tree over the sorted keys (FAST/S-tree style). Node
+ * k holds KARY_NODE_KEYS sorted keys and its KARY_NODE_KEYS + 1 children
+ * are the nodes k * (KARY_NODE_KEYS + 1) + i + 1. A lookup compares the key
+ * against a whole node at once and descends log17(n) nodes, one line each.
+ * Unused slots of the last nodes hold INT_MAX and have no tree node. */
+typedef struct _kary_tree
+{
+	int *keys;
+	node **nodes;
+	int num_blocks;
+	int num_nodes;
+} kary_tree;
+
+kary_tree *kary_build(node **sorted, int num_nodes);
+void kary_release(kary_tree *tree);
+const char *kary_isa_name(void);
+node *kary_search(kary_tree *tree, int key);
+void kary_search_batch(kary_tree *tree, int *keys, node **found_keys, int begin, int end);
+
+#endif
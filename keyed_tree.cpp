@@ -0,0 +1,120 @@
+/*******************************************************************************
+Copyright 2013 Advanced Micro Devices, Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1 Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+2 Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+/**
+********************************************************************************
+* @file <keyed_tree.cpp>
+*
+* @brief This file contains the instances of the templated Tree for 32 bit,
+* 64 bit and 16 byte keys and a benchmark of their batch search on the cpu.
+* The matching device kernel is ocl_search_keyed, built with the options of
+* keyed_ocl_options() so that its key type and compares match the host.
+*
+********************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include "keyed_tree.h"
+#include "workload.h"
+
+template class Tree<uint32_t, uint32_t>;
+template class Tree<uint64_t, uint64_t>;
+template class Tree<key128, uint64_t>;
+
+/* Build options of ocl_bst.cl for the key type of the given width */
+const char *keyed_ocl_options(int key_bits)
+{
+	switch (key_bits) {
+	case 64:	return "-I . -D BST_KEY_BITS=64";
+	case 128:	return "-I . -D BST_KEY_BITS=128";
+	default:	return "-I . -D BST_KEY_BITS=32";
+	}
+}
+
+/* Bulk loads num_nodes random keys and searches batches of num_search_keys,
+ * half of them keys of the tree, on num_thread threads. The keys come from
+ * the workload generator with the given seed. */
+template <typename Key, typename Value>
+static void keyed_benchmark(const char *name, int num_nodes, int num_search_keys, int num_thread, int iteration, uint64_t seed)
+{
+	typedef Tree<Key, Value> tree_type;
+	tree_type tree(num_nodes);
+	Key *keys, *search_keys;
+	Value *values;
+	const typename tree_type::tree_node **found;
+	long long start, ns = 0;
+	int found_count = 0;
+
+	if ((keys = (Key *)malloc(num_nodes * sizeof(Key))) == NULL ||
+		(values = (Value *)malloc(num_nodes * sizeof(Value))) == NULL ||
+		(search_keys = (Key *)malloc(num_search_keys * sizeof(Key))) == NULL ||
+		(found = (const typename tree_type::tree_node **)malloc(num_search_keys * sizeof(*found))) == NULL) {
+		printf("Error allocating memory for the keyed benchmark.\n");
+		exit(1);
+	}
+
+	keyed_tree_keys(keys, values, num_nodes, seed);
+	tree.bulk_load(keys, values, num_nodes);
+
+	for (int it = 0; it < iteration; it++) {
+		keyed_search_keys(search_keys, num_search_keys, keys, num_nodes, seed, it);
+
+		start = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+		tree.find_batch(search_keys, found, num_search_keys, num_thread);
+		ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count() - start;
+	}
+
+	for (int i = 0; i < num_search_keys; i++) {
+		if (found[i])
+			found_count++;
+	}
+
+	printf("Avg Time to search %d %s keys on the CPU = %.10f ms\n", num_search_keys, name, ns / 1e6 / iteration);
+	printf("Total keys found: %d\n\n", found_count);
+
+	free(keys);
+	free(values);
+	free(search_keys);
+	free(found);
+}
+
+void run_keyed_benchmark(int key_bits, int num_nodes, int num_search_keys, int num_thread, int iteration, uint64_t seed)
+{
+	switch (key_bits) {
+	case 64:
+		keyed_benchmark<uint64_t, uint64_t>("64 bit", num_nodes, num_search_keys, num_thread, iteration, seed);
+		break;
+	case 128:
+		keyed_benchmark<key128, uint64_t>("16 byte", num_nodes, num_search_keys, num_thread, iteration, seed);
+		break;
+	default:
+		keyed_benchmark<uint32_t, uint32_t>("32 bit", num_nodes, num_search_keys, num_thread, iteration, seed);
+		break;
+	}
+}
@@ -0,0 +1,298 @@
+#ifndef KEYED_TREE_H_
+#define KEYED_TREE_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <algorithm>
+#include "thread_pool.h"
+#include "workload.h"
+
+/* 16 byte key compared as (hi, lo). Also the layout of the key128 type of
+ * the ocl_search_keyed kernel built with -D BST_KEY_BITS=128. */
+typedef struct _key128
+{
+	uint64_t hi;
+	uint64_t lo;
+} key128;
+
+/* Strict weak order on the keys. The specializations are the search loop
+ * compares: a single compare for the integer keys, never a subtraction, and
+ * two 64 bit compares for key128. */
+template <typename Key>
+struct key_less
+{
+	bool operator()(const Key &a, const Key &b) const { return a < b; }
+};
+
+template <>
+struct key_less<key128>
+{
+	bool operator()(const key128 &a, const key128 &b) const
+	{
+		return (a.hi < b.hi) | ((a.hi == b.hi) & (a.lo < b.lo));
+	}
+};
+
+template <typename Key>
+inline bool key_equal(const Key &a, const Key &b)
+{
+	return a == b;
+}
+
+template <>
+inline bool key_equal<key128>(const key128 &a, const key128 &b)
+{
+	return ((a.hi ^ b.hi) | (a.lo ^ b.lo)) == 0;
+}
+
+/* Binary search tree with keys of type Key and a Value per key, the
+ * counterpart of node and its int value. The nodes live in one pool of
+ * capacity entries. insert() is the unbalanced construct_BST insert and
+ * bulk_load() links a balanced tree from unsorted keys. flatten() writes
+ * the BFS key/left/right arrays searched by the ocl_search_keyed kernel. */
+template <typename Key, typename Value, typename Compare = key_less<Key> >
+class Tree
+{
+public:
+	typedef struct _tree_node
+	{
+		Key key;
+		Value value;
+		struct _tree_node *left;
+		struct _tree_node *right;
+	} tree_node;
+
+	explicit Tree(int capacity) : root(NULL), num_nodes(0), capacity(capacity)
+	{
+		if ((pool = (tree_node *)malloc(capacity * sizeof(tree_node))) == NULL) {
+			printf("Error allocating memory for the keyed tree.\n");
+			exit(1);
+		}
+	}
+
+	~Tree()
+	{
+		free(pool);
+	}
+
+	/* The tree owns its node pool */
+	Tree(const Tree &) = delete;
+	Tree &operator=(const Tree &) = delete;
+
+	int size(void) const { return num_nodes; }
+
+	void insert(const Key &key, const Value &value)
+	{
+		tree_node *new_node = alloc_node(key, value);
+		tree_node **slot = &root;
+
+		while (*slot)
+			slot = less(key, (*slot)->key) ? &(*slot)->left : &(*slot)->right;
+
+		*slot = new_node;
+	}
+
+	/* Replaces the tree with a balanced tree of the n keys */
+	void bulk_load(const Key *keys, const Value *values, int n)
+	{
+		int *order;
+
+		if ((order = (int *)malloc(n * sizeof(int))) == NULL) {
+			printf("Error allocating memory for the keyed bulk load.\n");
+			exit(1);
+		}
+
+		for (int i = 0; i < n; i++)
+			order[i] = i;
+		std::sort(order, order + n, [&](int a, int b) { return less(keys[a], keys[b]); });
+
+		root = NULL;
+		num_nodes = 0;
+		for (int i = 0; i < n; i++)
+			alloc_node(keys[order[i]], values[order[i]]);
+		root = link_balanced(0, n);
+
+		free(order);
+	}
+
+	/* Node of the key, NULL if it is not in the tree. Keys neither less
+	 * than the other are equal, as Compare sees them. */
+	const tree_node *find(const Key &key) const
+	{
+		const tree_node *tmp_node = root;
+
+		while (tmp_node) {
+			if (less(key, tmp_node->key))
+				tmp_node = tmp_node->left;
+			else if (less(tmp_node->key, key))
+				tmp_node = tmp_node->right;
+			else
+				break;
+		}
+
+		return tmp_node;
+	}
+
+	/* found[i] is the node of keys[i], split over the thread pool as in
+	 * multithreaded_search */
+	void find_batch(const Key *keys, const tree_node **found, int num_keys, int num_thread) const
+	{
+		batch_arg barg = { this, keys, found };
+
+		thread_pool_init(num_thread);
+		thread_pool_run(find_range, &barg, num_keys);
+	}
+
+	/* BFS order key/left/right arrays of num_nodes entries. Returns the
+	 * root index, -1 for an empty tree. */
+	int flatten(Key *tree_keys, int *left, int *right) const
+	{
+		const tree_node **queue;
+		const tree_node *tmp_node;
+		int front = 0, rear = 0;
+
+		if (!root)
+			return -1;
+
+		if ((queue = (const tree_node **)malloc(num_nodes * sizeof(tree_node *))) == NULL) {
+			printf("Error creating tree queue.\n");
+			exit(1);
+		}
+
+		queue[rear++] = root;
+		while (front != rear) {
+			tmp_node = queue[front];
+			tree_keys[front] = tmp_node->key;
+			left[front] = right[front] = -1;
+
+			if (tmp_node->left) {
+				left[front] = rear;
+				queue[rear++] = tmp_node->left;
+			}
+			if (tmp_node->right) {
+				right[front] = rear;
+				queue[rear++] = tmp_node->right;
+			}
+			front++;
+		}
+
+		free(queue);
+
+		return 0;
+	}
+
+private:
+	typedef struct _batch_arg
+	{
+		const Tree *tree;
+		const Key *keys;
+		const tree_node **found;
+	} batch_arg;
+
+	static void find_range(void *arg, int begin, int end, int worker_id)
+	{
+		batch_arg *barg = (batch_arg *)arg;
+
+		for (int i = begin; i < end; i++)
+			barg->found[i] = barg->tree->find(barg->keys[i]);
+	}
+
+	tree_node *alloc_node(const Key &key, const Value &value)
+	{
+		tree_node *new_node;
+
+		if (num_nodes == capacity) {
+			printf("Keyed tree is full (%d nodes).\n", capacity);
+			exit(1);
+		}
+
+		new_node = &pool[num_nodes++];
+		new_node->key = key;
+		new_node->value = value;
+		new_node->left = NULL;
+		new_node->right = NULL;
+
+		return new_node;
+	}
+
+	/* Balanced subtree over the sorted pool entries [begin, end) */
+	tree_node *link_balanced(int begin, int end)
+	{
+		int mid;
+		tree_node *tmp_node;
+
+		if (begin >= end)
+			return NULL;
+
+		mid = begin + (end - begin) / 2;
+		tmp_node = &pool[mid];
+		tmp_node->left = link_balanced(begin, mid);
+		tmp_node->right = link_balanced(mid + 1, end);
+
+		return tmp_node;
+	}
+
+	tree_node *root;
+	tree_node *pool;
+	int num_nodes;
+	int capacity;
+	Compare less;
+};
+
+/* The key types with specialized search loops, instantiated once in
+ * keyed_tree.cpp */
+typedef Tree<uint32_t, uint32_t> tree_u32;
+typedef Tree<uint64_t, uint64_t> tree_u64;
+typedef Tree<key128, uint64_t> tree_k128;
+
+extern template class Tree<uint32_t, uint32_t>;
+extern template class Tree<uint64_t, uint64_t>;
+extern template class Tree<key128, uint64_t>;
+
+/* Key i of a workload stream, uniform over the whole key type */
+static inline void keyed_make_key(uint64_t seed, uint64_t stream, uint64_t i, uint32_t *key)
+{
+	*key = (uint32_t)workload_random(seed, stream, i);
+}
+
+static inline void keyed_make_key(uint64_t seed, uint64_t stream, uint64_t i, uint64_t *key)
+{
+	*key = workload_random(seed, stream, i);
+}
+
+static inline void keyed_make_key(uint64_t seed, uint64_t stream, uint64_t i, key128 *key)
+{
+	key->hi = workload_random(seed, stream, 2 * i);
+	key->lo = workload_random(seed, stream, 2 * i + 1);
+}
+
+/* The num_nodes keys of the tree, the value of a key is its index */
+template <typename Key, typename Value>
+void keyed_tree_keys(Key *keys, Value *values, int num_nodes, uint64_t seed)
+{
+	for (int i = 0; i < num_nodes; i++) {
+		keyed_make_key(seed, WORKLOAD_STREAM_KEYED, i, &keys[i]);
+		values[i] = (Value)i;
+	}
+}
+
+/* Search batch number batch, the even entries are keys of the tree and the
+ * odd ones random keys. The cpu and the OpenCL runs search the same batches. */
+template <typename Key>
+void keyed_search_keys(Key *search_keys, int num_search_keys, const Key *keys, int num_nodes, uint64_t seed, int batch)
+{
+	uint64_t stream = WORKLOAD_STREAM_SEARCH + batch;
+
+	for (int i = 0; i < num_search_keys; i++) {
+		if (i & 1)
+			keyed_make_key(seed, stream, i, &search_keys[i]);
+		else
+			search_keys[i] = keys[workload_random(seed, stream ^ 0x800000, i) % num_nodes];
+	}
+}
+
+const char *keyed_ocl_options(int key_bits);
+void run_keyed_benchmark(int key_bits, int num_nodes, int num_search_keys, int num_thread, int iteration, uint64_t seed);
+
+#endif
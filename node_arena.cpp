@@ -0,0 +1,233 @@
+/*******************************************************************************
+Copyright 2013 Advanced Micro Devices, Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1 Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+2 Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+/**
+********************************************************************************
+* @file <node_arena.cpp>
+*
+* @brief This file contains the arena the tree nodes are allocated from.
+* A search touches one node per level at random places of the node pool,
+* so with 4K pages nearly every node read also misses the TLB. The arena
+* maps the pool with 2MB or 1GB pages when the system has them reserved,
+* else asks for transparent huge pages, else uses 4K pages.
+*
+********************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "node_arena.h"
+
+#ifdef _MSC_VER
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#endif
+
+#define ARENA_ALIGN 64
+#define ARENA_SIZE_2M (2ULL << 20)
+
+static size_t round_up(size_t size, size_t align)
+{
+	return (size + align - 1) / align * align;
+}
+
+#ifdef _MSC_VER
+
+/* Large pages need the SeLockMemoryPrivilege (Lock pages in memory) of the
+ * user. Windows maps them in GetLargePageMinimum() units, 1GB pages are
+ * not available through VirtualAlloc. */
+static int map_arena(node_arena *arena, size_t capacity, int pages)
+{
+	size_t large = GetLargePageMinimum();
+	SYSTEM_INFO info;
+
+	if (pages != ARENA_PAGES_SMALL && large) {
+		arena->size = round_up(capacity, large);
+		arena->base = (char *)VirtualAlloc(NULL, arena->size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+		if (arena->base) {
+			arena->page_size = large;
+			arena->backing = ARENA_BACKING_HUGE;
+			return 1;
+		}
+		printf("Large pages are not available (error %lu), using 4K pages.\n", GetLastError());
+	}
+
+	GetSystemInfo(&info);
+	arena->size = round_up(capacity, info.dwPageSize);
+	arena->base = (char *)VirtualAlloc(NULL, arena->size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	arena->page_size = info.dwPageSize;
+	arena->backing = ARENA_BACKING_SMALL;
+
+	return arena->base != NULL;
+}
+
+static void unmap_arena(node_arena *arena)
+{
+	VirtualFree(arena->base, 0, MEM_RELEASE);
+}
+
+#else
+
+static int map_arena(node_arena *arena, size_t capacity, int pages)
+{
+	int huge_shift = (pages == ARENA_PAGES_1G) ? 30 : 21;
+	void *p;
+	char *aligned;
+	size_t span;
+
+	if (pages != ARENA_PAGES_SMALL) {
+		/* Pages reserved in /proc/sys/vm/nr_hugepages, or per size in
+		 * /sys/kernel/mm/hugepages. Without 1GB pages try 2MB ones. */
+		for (; huge_shift >= 21; huge_shift -= 9) {
+			arena->size = round_up(capacity, (size_t)1 << huge_shift);
+			p = mmap(NULL, arena->size, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (huge_shift << MAP_HUGE_SHIFT), -1, 0);
+			if (p != MAP_FAILED) {
+				arena->base = (char *)p;
+				arena->page_size = (size_t)1 << huge_shift;
+				arena->backing = ARENA_BACKING_HUGE;
+				return 1;
+			}
+		}
+
+		/* No reserved pages, map on a 2MB boundary and let the
+		 * kernel back it with transparent huge pages */
+		arena->size = round_up(capacity, ARENA_SIZE_2M);
+		span = arena->size + ARENA_SIZE_2M;
+		p = mmap(NULL, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p != MAP_FAILED) {
+			aligned = (char *)round_up((size_t)p, ARENA_SIZE_2M);
+			if (aligned != (char *)p)
+				munmap(p, aligned - (char *)p);
+			if ((char *)p + span != aligned + arena->size)
+				munmap(aligned + arena->size, (char *)p + span - (aligned + arena->size));
+
+			arena->base = aligned;
+#ifdef MADV_HUGEPAGE
+			if (madvise(aligned, arena->size, MADV_HUGEPAGE) == 0) {
+				arena->page_size = ARENA_SIZE_2M;
+				arena->backing = ARENA_BACKING_THP;
+				return 1;
+			}
+#endif
+			printf("Huge pages are not available, using 4K pages.\n");
+			arena->page_size = (size_t)sysconf(_SC_PAGESIZE);
+			arena->backing = ARENA_BACKING_SMALL;
+			return 1;
+		}
+	}
+
+	arena->page_size = (size_t)sysconf(_SC_PAGESIZE);
+	arena->size = round_up(capacity, arena->page_size);
+	p = mmap(NULL, arena->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	arena->base = (p == MAP_FAILED) ? NULL : (char *)p;
+	arena->backing = ARENA_BACKING_SMALL;
+
+	return arena->base != NULL;
+}
+
+static void unmap_arena(node_arena *arena)
+{
+	munmap(arena->base, arena->size);
+}
+
+#endif
+
+/* Maps an arena of at least capacity bytes with the pages asked for, or
+ * the best the system has. The pages are faulted in by the first writes,
+ * so the threads that initialize the nodes place them. */
+node_arena *arena_create(size_t capacity, int pages)
+{
+	node_arena *arena;
+
+	if ((arena = (node_arena *)calloc(1, sizeof(node_arena))) == NULL) {
+		printf("Error allocating memory for the node arena.\n");
+		exit(1);
+	}
+
+	if (capacity == 0)
+		capacity = ARENA_ALIGN;
+
+	if (!map_arena(arena, capacity, pages)) {
+		printf("Error mapping %llu bytes for the node arena.\n", (unsigned long long)capacity);
+		exit(1);
+	}
+
+	return arena;
+}
+
+/* Hands out size bytes on a cache line boundary. Called from one thread. */
+void *arena_alloc(node_arena *arena, size_t size)
+{
+	size_t offset = round_up(arena->used, ARENA_ALIGN);
+
+	if (offset + size > arena->size) {
+		printf("Node arena is full (%llu of %llu bytes used).\n",
+			(unsigned long long)arena->used, (unsigned long long)arena->size);
+		exit(1);
+	}
+
+	arena->used = offset + size;
+	arena->num_allocs++;
+
+	return arena->base + offset;
+}
+
+void arena_release(node_arena *arena)
+{
+	if (!arena)
+		return;
+
+	unmap_arena(arena);
+	free(arena);
+}
+
+const char *arena_pages_name(int pages)
+{
+	switch (pages) {
+	case ARENA_PAGES_SMALL: return "4K pages";
+	case ARENA_PAGES_2M: return "2MB huge pages";
+	case ARENA_PAGES_1G: return "1GB huge pages";
+	default: return "unknown";
+	}
+}
+
+void arena_print_stats(const node_arena *arena)
+{
+	static const char *backing_name[] = { "small pages", "reserved huge pages", "transparent huge pages" };
+
+	if (!arena)
+		return;
+
+	printf("Node arena: %.2f MB mapped with %s of %llu KB, %.2f MB used by %d allocations\n",
+		arena->size / 1048576.0, backing_name[arena->backing], (unsigned long long)(arena->page_size >> 10),
+		arena->used / 1048576.0, arena->num_allocs);
+}
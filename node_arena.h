@@ -0,0 +1,36 @@
+#ifndef NODE_ARENA_H_
+#define NODE_ARENA_H_
+
+#include <stddef.h>
+
+/* Pages requested for an arena */
+#define ARENA_PAGES_SMALL 0	// 4K pages
+#define ARENA_PAGES_2M 1	// 2MB huge pages
+#define ARENA_PAGES_1G 2	// 1GB huge pages
+#define ARENA_PAGES_COUNT 3
+
+/* How the arena memory is actually backed */
+#define ARENA_BACKING_SMALL 0	// 4K pages
+#define ARENA_BACKING_HUGE 1	// Reserved huge pages (MAP_HUGETLB, MEM_LARGE_PAGES)
+#define ARENA_BACKING_THP 2	// 4K pages the kernel may merge into huge pages
+
+/* One mapping carved by a bump pointer. Every allocation starts on a cache
+ * line, so a node never straddles two lines more than its size needs. The
+ * memory is only returned with the whole arena. */
+typedef struct _node_arena
+{
+	char *base;
+	size_t size;		// Bytes mapped, a multiple of page_size
+	size_t used;		// Bytes handed out, including the alignment
+	size_t page_size;	// Page size of the backing
+	int backing;
+	int num_allocs;
+} node_arena;
+
+node_arena *arena_create(size_t capacity, int pages);
+void *arena_alloc(node_arena *arena, size_t size);
+void arena_release(node_arena *arena);
+const char *arena_pages_name(int pages);
+void arena_print_stats(const node_arena *arena);
+
+#endif
@@ -0,0 +1,196 @@
+/*******************************************************************************
+Copyright 2013 Advanced Micro Devices, Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1 Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+2 Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+/**
+********************************************************************************
+* @file <numa_replica.cpp>
+*
+* @brief This file contains the NUMA topology and the memory placement used
+* to replicate the read mostly flattened tree once per NUMA node. The
+* nodes are numbered densely from 0, whatever the ids of the system. On
+* Linux the pages of a replica are bound to its node with mbind(2) before
+* they are first touched, on Windows they are allocated with
+* VirtualAllocExNuma. No NUMA library is needed.
+*
+********************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#include "numa_replica.h"
+
+#ifndef MPOL_BIND
+#define MPOL_BIND 2
+#endif
+
+/* Largest cpu number mapped to its node, the others count as node 0 */
+#define NUMA_MAX_CPUS 1024
+
+static int num_nodes = 0;		// 0 until the topology is read
+static int node_ids[NUMA_MAX_NODES];	// System id of each dense node number
+static int cpu_node[NUMA_MAX_CPUS];
+
+#ifdef _WIN32
+
+static void read_topology(void)
+{
+	ULONG highest = 0;
+	UCHAR node_id;
+
+	if (!GetNumaHighestNodeNumber(&highest))
+		highest = 0;
+
+	for (ULONG n = 0; n <= highest && num_nodes < NUMA_MAX_NODES; n++)
+		node_ids[num_nodes++] = (int)n;
+
+	for (int cpu = 0; cpu < NUMA_MAX_CPUS && cpu < 256; cpu++) {
+		if (GetNumaProcessorNode((UCHAR)cpu, &node_id) && node_id != 0xFF && node_id < num_nodes)
+			cpu_node[cpu] = node_id;
+	}
+}
+
+#else
+
+static void read_topology(void)
+{
+	char path[128];
+	int num_cpus = (int)sysconf(_SC_NPROCESSORS_CONF);
+
+	for (int id = 0; id < NUMA_MAX_NODES; id++) {
+		snprintf(path, sizeof(path), "/sys/devices/system/node/node%d", id);
+		if (access(path, F_OK) == 0)
+			node_ids[num_nodes++] = id;
+	}
+
+	/* No sysfs node entries, a single node system */
+	if (num_nodes == 0) {
+		node_ids[0] = 0;
+		num_nodes = 1;
+	}
+
+	for (int cpu = 0; cpu < num_cpus && cpu < NUMA_MAX_CPUS; cpu++) {
+		for (int n = 0; n < num_nodes; n++) {
+			snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/node%d", cpu, node_ids[n]);
+			if (access(path, F_OK) == 0) {
+				cpu_node[cpu] = n;
+				break;
+			}
+		}
+	}
+}
+
+#endif
+
+int numa_node_count(void)
+{
+	if (!num_nodes)
+		read_topology();
+
+	return num_nodes;
+}
+
+/* Dense number of the node of the cpu, 0 for an unknown cpu */
+int numa_cpu_node(int cpu)
+{
+	if (!num_nodes)
+		read_topology();
+
+	if (cpu < 0 || cpu >= NUMA_MAX_CPUS)
+		return 0;
+
+	return cpu_node[cpu];
+}
+
+/* Allocates size bytes whose pages live on the node. *bound is 0 when the
+ * placement could not be enforced and the pages go where they are first
+ * touched. */
+void *numa_alloc_on_node(size_t size, int node_id, int *bound)
+{
+	void *p;
+
+	if (!num_nodes)
+		read_topology();
+
+#ifdef _WIN32
+	p = VirtualAllocExNuma(GetCurrentProcess(), NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, node_ids[node_id]);
+	*bound = (p != NULL);
+	if (!p)
+		p = VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+	/* One bit per system node id, the ids past the mask are not bound */
+	unsigned long mask[(NUMA_MAX_NODES + 8 * sizeof(unsigned long) - 1) / (8 * sizeof(unsigned long))] = { 0 };
+	const int bits = (int)(8 * sizeof(unsigned long));
+	int id = node_ids[node_id];
+
+	p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		p = NULL;
+
+	*bound = 0;
+#ifdef SYS_mbind
+	if (p && id >= 0 && id < (int)sizeof(mask) * 8) {
+		mask[id / bits] = 1UL << (id % bits);
+		*bound = (syscall(SYS_mbind, p, size, MPOL_BIND, mask, sizeof(mask) * 8, 0) == 0);
+	}
+#endif
+#endif
+
+	if (!p) {
+		printf("Error allocating memory on NUMA node %d.\n", node_id);
+		exit(1);
+	}
+
+	return p;
+}
+
+void numa_free(void *p, size_t size)
+{
+	if (!p)
+		return;
+
+#ifdef _WIN32
+	VirtualFree(p, 0, MEM_RELEASE);
+#else
+	munmap(p, size);
+#endif
+}
+
+const char *numa_replica_name(int mode)
+{
+	switch (mode) {
+	case NUMA_REPLICA_OFF: return "single copy";
+	case NUMA_REPLICA_LOCAL: return "local replicas";
+	case NUMA_REPLICA_REMOTE: return "remote replicas";
+	default: return "unknown";
+	}
+}
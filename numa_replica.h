@@ -0,0 +1,20 @@
+#ifndef NUMA_REPLICA_H_
+#define NUMA_REPLICA_H_
+
+#include <stddef.h>
+
+/* Largest number of NUMA nodes with a replica of their own. */
+#define NUMA_MAX_NODES 64
+
+/* Replica a search worker reads */
+#define NUMA_REPLICA_OFF 0		// One copy, wherever its pages landed
+#define NUMA_REPLICA_LOCAL 1	// The replica on the node of the worker's cpu
+#define NUMA_REPLICA_REMOTE 2	// The replica on the next node, to measure remote reads
+
+int numa_node_count(void);
+int numa_cpu_node(int cpu);
+void *numa_alloc_on_node(size_t size, int node_id, int *bound);
+void numa_free(void *p, size_t size);
+const char *numa_replica_name(int mode);
+
+#endif
@@ -1,6 +1,26 @@
 #ifndef OCL_BST_SEARCH_H_
 #define OCL_BST_SEARCH_H_
 
+/* Keep the live key count of every subtree in node and ocl_node, which rank
+ * and select (-k) need. It costs 4 bytes per node and a write to every
+ * ancestor of an insert or delete, comment it out for trees that are only
+ * searched. The kernels see it through this header as well. */
+#define BST_SUBTREE_SIZE
+
+/* Tree layouts searched by the OpenCL path */
+#define OCL_LAYOUT_BFS			0	// ocl_node array in BFS order (ocl_search)
+#define OCL_LAYOUT_EYTZINGER	1	// implicit Eytzinger key array (ocl_search_eytzinger)
+#define OCL_LAYOUT_COMPACT		2	// ocl_compact_node array in BFS order (ocl_search_compact)
+#define OCL_LAYOUT_SOA			3	// BFS key/left/right arrays (ocl_search_soa)
+
+/* Nearest key queries of bound_search and the ocl_bound_search kernel */
+#define BOUND_NONE			-1
+#define BOUND_LOWER			0	// smallest key >= the search key
+#define BOUND_UPPER			1	// smallest key > the search key
+#define BOUND_PREDECESSOR	2	// largest key < the search key
+#define BOUND_SUCCESSOR		3	// smallest key > the search key, same as BOUND_UPPER
+#define BOUND_COUNT			4
+
 typedef struct ocl_bin_tree
 {
     int value;     // Value at a node
@@ -9,6 +29,19 @@ typedef struct ocl_bin_tree
     int left;      // index to the left node
     int right;     // index to the right node
 	int parent;
+#ifdef BST_SUBTREE_SIZE
+	int size;      // live keys in the subtree
+#endif
 } ocl_node;
 
+/* Packed node for the search path: key and child indices only. 12 bytes
+ * instead of the 24 of ocl_node, 28 with BST_SUBTREE_SIZE, so five nodes
+ * share a 64 byte line. */
+typedef struct ocl_compact_bin_tree
+{
+	int value;     // Value at a node
+	int left;      // index to the left node
+	int right;     // index to the right node
+} ocl_compact_node;
+
 #endif
\ No newline at end of file
@@ -38,3 +38,489 @@ __kernel void ocl_search(
 	}
 }
 
+/*
+ * This kernel searches a set of keys on the Eytzinger layout of the BST.
+ * The layout is 1 based, the children of slot k are slots 2k and 2k + 1.
+ * Arguments:
+ *		1. Eytzinger array of keys (slot 0 is padding).
+ *		2. Number of nodes in the array.
+ *		3. An array of keys to be searched.
+ *		4. Number of keys to be searched.
+ *		5. An array of the slots found in the search, -1 if not found.
+ */
+
+__kernel void ocl_search_eytzinger(
+			__global int *tree,
+			int num_nodes,
+			__global int *search_keys,
+			int num_search_keys,
+			__global int *found_nodes_id) 
+{
+	ulong k, turns;
+
+	int gid = get_global_id(0);
+	int nodes_per_wi = (num_search_keys / get_global_size(0));
+	int init_id = gid * nodes_per_wi;
+	int i, key;
+
+	for (i = init_id; i < init_id + nodes_per_wi; i++) {
+		key = search_keys[i];
+
+		/* Branchless descent, the comparison is the next bit of k. */
+		k = 1;
+		while (k <= (ulong)num_nodes) {
+			prefetch(tree + min(16 * k, (ulong)num_nodes), 16);
+			k = 2 * k + (tree[k] < key);
+		}
+
+		/* Drop the right turns taken after the lower bound and the final
+		 * left turn, i.e. shift out the trailing ones and one zero. */
+		turns = ~k;
+		k >>= 64 - clz(turns & (0 - turns));
+
+		found_nodes_id[i] = (k && tree[k] == key) ? (int)k : -1;
+	}
+}
+
+/*
+ * This kernel searches a set of keys on the compact BFS array of the BST.
+ * Same search as ocl_search on 12 byte nodes holding only the key and the
+ * child indices.
+ * Arguments:
+ *		1. BFS array of ocl_compact_node.
+ *		2. Index of the root node.
+ *		3. An array of keys to be searched.
+ *		4. Number of keys to be searched.
+ *		5. An array of node indices found in the search, -1 if not found.
+ */
+
+__kernel void ocl_search_compact(
+			__global ocl_compact_node *tree,
+			int root_id,
+			__global int *search_keys,
+			int num_search_keys,
+			__global int *found_nodes_id) 
+{
+	int tmp_node_id; 
+	
+	int gid = get_global_id(0);
+	int nodes_per_wi = (num_search_keys / get_global_size(0));
+	int init_id = gid * nodes_per_wi;
+	int i, key;
+
+	for (i = init_id; i < init_id + nodes_per_wi; i++) {
+		key = search_keys[i];
+	
+		tmp_node_id = root_id;
+	
+		while (1) {
+			if ((tmp_node_id == -1) || (tree[tmp_node_id].value == key))
+				break;
+
+			tmp_node_id = (key < tree[tmp_node_id].value) ? tree[tmp_node_id].left : tree[tmp_node_id].right;
+		}
+	
+		found_nodes_id[i] = tmp_node_id;
+	}
+}
+
+/*
+ * This kernel searches a set of keys on the structure of arrays form of the
+ * BFS array: keys, left and right child indices in three arrays.
+ * Arguments:
+ *		1. Keys of the nodes in BFS order.
+ *		2. Index of the left child of each node, -1 if none.
+ *		3. Index of the right child of each node, -1 if none.
+ *		4. Index of the root node.
+ *		5. An array of keys to be searched.
+ *		6. Number of keys to be searched.
+ *		7. An array of node indices found in the search, -1 if not found.
+ */
+
+__kernel void ocl_search_soa(
+			__global int *tree_keys,
+			__global int *left,
+			__global int *right,
+			int root_id,
+			__global int *search_keys,
+			int num_search_keys,
+			__global int *found_nodes_id) 
+{
+	int tmp_node_id, node_key; 
+	
+	int gid = get_global_id(0);
+	int nodes_per_wi = (num_search_keys / get_global_size(0));
+	int init_id = gid * nodes_per_wi;
+	int i, key;
+
+	for (i = init_id; i < init_id + nodes_per_wi; i++) {
+		key = search_keys[i];
+	
+		tmp_node_id = root_id;
+	
+		while (1) {
+			if (tmp_node_id == -1)
+				break;
+
+			node_key = tree_keys[tmp_node_id];
+			if (node_key == key)
+				break;
+
+			tmp_node_id = (key < node_key) ? left[tmp_node_id] : right[tmp_node_id];
+		}
+	
+		found_nodes_id[i] = tmp_node_id;
+	}
+}
+
+
+/*
+ * This kernel answers nearest key queries on the BFS array of the BST with
+ * the same split of the keys over the work items as ocl_search. The walk
+ * keeps the last node on the wanted side of the key.
+ * Arguments:
+ *		1. BFS array of ocl_node.
+ *		2. Index of the root node.
+ *		3. Query, one of the BOUND_* values.
+ *		4. An array of keys to be searched.
+ *		5. Number of keys to be searched.
+ *		6. An array of node indices answering the query, -1 if none.
+ */
+
+__kernel void ocl_bound_search(
+			__global ocl_node *tree,
+			int root_id,
+			int query,
+			__global int *search_keys,
+			int num_search_keys,
+			__global int *found_nodes_id) 
+{
+	int tmp_node_id, best_id, node_key, go_left;
+	
+	int gid = get_global_id(0);
+	int nodes_per_wi = (num_search_keys / get_global_size(0));
+	int init_id = gid * nodes_per_wi;
+	int i, key;
+
+	for (i = init_id; i < init_id + nodes_per_wi; i++) {
+		key = search_keys[i];
+	
+		tmp_node_id = root_id;
+		best_id = -1;
+	
+		while (tmp_node_id != -1) {
+			node_key = tree[tmp_node_id].value;
+
+			if (query == BOUND_PREDECESSOR) {
+				go_left = (key <= node_key);
+				best_id = go_left ? best_id : tmp_node_id;
+			}
+			else {
+				go_left = (key < node_key) || (query == BOUND_LOWER && key == node_key);
+				best_id = go_left ? tmp_node_id : best_id;
+			}
+
+			tmp_node_id = go_left ? tree[tmp_node_id].left : tree[tmp_node_id].right;
+		}
+	
+		found_nodes_id[i] = best_id;
+	}
+}
+
+/* Index of the first node with a key >= lo, -1 if none. */
+int ocl_range_first(__global ocl_node *tree, int root_id, int lo)
+{
+	int tmp_node_id = root_id;
+	int best_id = -1;
+
+	while (tmp_node_id != -1) {
+		if (lo <= tree[tmp_node_id].value) {
+			best_id = tmp_node_id;
+			tmp_node_id = tree[tmp_node_id].left;
+		}
+		else {
+			tmp_node_id = tree[tmp_node_id].right;
+		}
+	}
+
+	return best_id;
+}
+
+/* Index of the next node in key order through the parent indices, -1 after
+ * the largest. */
+int ocl_range_next(__global ocl_node *tree, int tmp_node_id)
+{
+	int parent_id;
+
+	if (tree[tmp_node_id].right != -1) {
+		tmp_node_id = tree[tmp_node_id].right;
+		while (tree[tmp_node_id].left != -1)
+			tmp_node_id = tree[tmp_node_id].left;
+		return tmp_node_id;
+	}
+
+	parent_id = tree[tmp_node_id].parent;
+	while (parent_id != -1 && tree[parent_id].right == tmp_node_id) {
+		tmp_node_id = parent_id;
+		parent_id = tree[parent_id].parent;
+	}
+
+	return parent_id;
+}
+
+/*
+ * This kernel counts the keys of the ranges [lo, hi) on the BFS array of the
+ * BST. The walk from the first key of the range follows the parent indices,
+ * so it needs no stack.
+ * Arguments:
+ *		1. BFS array of ocl_node with parent indices.
+ *		2. Index of the root node.
+ *		3. An array of the range starts.
+ *		4. An array of the range ends, not included.
+ *		5. Number of ranges.
+ *		6. An array of the number of keys in each range.
+ */
+
+__kernel void ocl_range_count(
+			__global ocl_node *tree,
+			int root_id,
+			__global int *lo_keys,
+			__global int *hi_keys,
+			int num_ranges,
+			__global int *counts) 
+{
+	int tmp_node_id, count, hi;
+	
+	int gid = get_global_id(0);
+	int ranges_per_wi = (num_ranges / get_global_size(0));
+	int init_id = gid * ranges_per_wi;
+	int i;
+
+	for (i = init_id; i < init_id + ranges_per_wi; i++) {
+		hi = hi_keys[i];
+		count = 0;
+
+		tmp_node_id = ocl_range_first(tree, root_id, lo_keys[i]);
+		while (tmp_node_id != -1 && tree[tmp_node_id].value < hi) {
+			count++;
+			tmp_node_id = ocl_range_next(tree, tmp_node_id);
+		}
+	
+		counts[i] = count;
+	}
+}
+
+/*
+ * This kernel writes the node indices of the ranges [lo, hi) to one packed
+ * array. The offsets are the exclusive prefix sum of the ocl_range_count
+ * results.
+ * Arguments:
+ *		1. BFS array of ocl_node with parent indices.
+ *		2. Index of the root node.
+ *		3. An array of the range starts.
+ *		4. An array of the range ends, not included.
+ *		5. Number of ranges.
+ *		6. Offset of the first result of each range.
+ *		7. Packed array of the node indices of all ranges in key order.
+ */
+
+__kernel void ocl_range_scan(
+			__global ocl_node *tree,
+			int root_id,
+			__global int *lo_keys,
+			__global int *hi_keys,
+			int num_ranges,
+			__global int *offsets,
+			__global int *found_nodes_id) 
+{
+	int tmp_node_id, out, hi;
+	
+	int gid = get_global_id(0);
+	int ranges_per_wi = (num_ranges / get_global_size(0));
+	int init_id = gid * ranges_per_wi;
+	int i;
+
+	for (i = init_id; i < init_id + ranges_per_wi; i++) {
+		hi = hi_keys[i];
+		out = offsets[i];
+
+		tmp_node_id = ocl_range_first(tree, root_id, lo_keys[i]);
+		while (tmp_node_id != -1 && tree[tmp_node_id].value < hi) {
+			found_nodes_id[out++] = tmp_node_id;
+			tmp_node_id = ocl_range_next(tree, tmp_node_id);
+		}
+	}
+}
+
+#ifdef BST_SUBTREE_SIZE
+/*
+ * This kernel computes the rank of a set of keys, the number of keys of the
+ * BST smaller than each, from the subtree sizes of the BFS array. A node
+ * counts for size - size of its children, which is 0 for a deleted node.
+ * Arguments:
+ *		1. BFS array of ocl_node with subtree sizes.
+ *		2. Index of the root node.
+ *		3. An array of keys to be ranked.
+ *		4. Number of keys to be ranked.
+ *		5. An array of the ranks.
+ */
+
+__kernel void ocl_rank(
+			__global ocl_node *tree,
+			int root_id,
+			__global int *search_keys,
+			int num_search_keys,
+			__global int *ranks) 
+{
+	int tmp_node_id, right_id, rank;
+	
+	int gid = get_global_id(0);
+	int nodes_per_wi = (num_search_keys / get_global_size(0));
+	int init_id = gid * nodes_per_wi;
+	int i, key;
+
+	for (i = init_id; i < init_id + nodes_per_wi; i++) {
+		key = search_keys[i];
+	
+		tmp_node_id = root_id;
+		rank = 0;
+	
+		while (tmp_node_id != -1) {
+			if (key <= tree[tmp_node_id].value) {
+				tmp_node_id = tree[tmp_node_id].left;
+			}
+			else {
+				right_id = tree[tmp_node_id].right;
+				rank += tree[tmp_node_id].size - ((right_id == -1) ? 0 : tree[right_id].size);
+				tmp_node_id = right_id;
+			}
+		}
+	
+		ranks[i] = rank;
+	}
+}
+
+/*
+ * This kernel finds the keys of a set of ranks on the BFS array.
+ * Arguments:
+ *		1. BFS array of ocl_node with subtree sizes.
+ *		2. Index of the root node.
+ *		3. An array of ranks, 0 is the smallest key.
+ *		4. Number of ranks.
+ *		5. An array of node indices of the ranks, -1 if out of range.
+ */
+
+__kernel void ocl_select(
+			__global ocl_node *tree,
+			int root_id,
+			__global int *search_ranks,
+			int num_search_keys,
+			__global int *found_nodes_id) 
+{
+	int tmp_node_id, left_id, right_id, left_size, own;
+	
+	int gid = get_global_id(0);
+	int nodes_per_wi = (num_search_keys / get_global_size(0));
+	int init_id = gid * nodes_per_wi;
+	int i, k;
+
+	for (i = init_id; i < init_id + nodes_per_wi; i++) {
+		k = search_ranks[i];
+	
+		tmp_node_id = root_id;
+	
+		while (tmp_node_id != -1) {
+			left_id = tree[tmp_node_id].left;
+			right_id = tree[tmp_node_id].right;
+			left_size = (left_id == -1) ? 0 : tree[left_id].size;
+			own = tree[tmp_node_id].size - left_size - ((right_id == -1) ? 0 : tree[right_id].size);
+
+			if (k < left_size) {
+				tmp_node_id = left_id;
+			}
+			else if (k < left_size + own) {
+				break;
+			}
+			else {
+				k -= left_size + own;
+				tmp_node_id = right_id;
+			}
+		}
+	
+		found_nodes_id[i] = tmp_node_id;
+	}
+}
+#endif
+
+/* Key type of ocl_search_keyed, chosen at build time with
+ * -D BST_KEY_BITS=32, 64 or 128 (keyed_ocl_options() on the host). The
+ * compares never subtract keys, so they do not overflow. */
+#ifndef BST_KEY_BITS
+#define BST_KEY_BITS 32
+#endif
+
+#if BST_KEY_BITS == 128
+typedef struct _key128
+{
+	ulong hi;
+	ulong lo;
+} key128;
+typedef key128 bst_key;
+#define KEY_LESS(a, b)	(((a).hi < (b).hi) | (((a).hi == (b).hi) & ((a).lo < (b).lo)))
+#define KEY_EQUAL(a, b)	((((a).hi ^ (b).hi) | ((a).lo ^ (b).lo)) == 0)
+#elif BST_KEY_BITS == 64
+typedef ulong bst_key;
+#define KEY_LESS(a, b)	((a) < (b))
+#define KEY_EQUAL(a, b)	((a) == (b))
+#else
+typedef uint bst_key;
+#define KEY_LESS(a, b)	((a) < (b))
+#define KEY_EQUAL(a, b)	((a) == (b))
+#endif
+
+/*
+ * This kernel searches a set of keys of type bst_key on the BFS arrays
+ * written by Tree::flatten().
+ * Arguments:
+ *		1. Keys of the nodes in BFS order.
+ *		2. Index of the left child of each node, -1 if none.
+ *		3. Index of the right child of each node, -1 if none.
+ *		4. Index of the root node.
+ *		5. An array of keys to be searched.
+ *		6. Number of keys to be searched.
+ *		7. An array of node indices found in the search, -1 if not found.
+ */
+
+__kernel void ocl_search_keyed(
+			__global bst_key *tree_keys,
+			__global int *left,
+			__global int *right,
+			int root_id,
+			__global bst_key *search_keys,
+			int num_search_keys,
+			__global int *found_nodes_id) 
+{
+	int tmp_node_id;
+	bst_key key, node_key;
+	
+	int gid = get_global_id(0);
+	int nodes_per_wi = (num_search_keys / get_global_size(0));
+	int init_id = gid * nodes_per_wi;
+	int i;
+
+	for (i = init_id; i < init_id + nodes_per_wi; i++) {
+		key = search_keys[i];
+	
+		tmp_node_id = root_id;
+	
+		while (tmp_node_id != -1) {
+			node_key = tree_keys[tmp_node_id];
+			if (KEY_EQUAL(node_key, key))
+				break;
+
+			tmp_node_id = KEY_LESS(key, node_key) ? left[tmp_node_id] : right[tmp_node_id];
+		}
+	
+		found_nodes_id[i] = tmp_node_id;
+	}
+}
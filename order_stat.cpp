@@ -0,0 +1,184 @@
+/*******************************************************************************
+Copyright 2013 Advanced Micro Devices, Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1 Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+2 Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+/**
+********************************************************************************
+* @file <order_stat.cpp>
+*
+* @brief This file contains the rank and select queries on the cpu. Every node
+* keeps the number of live keys in its subtree, so both queries are a single
+* walk from the root: rank adds up the sizes of the subtrees left of the path,
+* select picks the side whose size still holds the wanted position. A deleted
+* node that still routes the searches counts for its subtrees only.
+*
+********************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "cpu_BST.h"
+#include "thread_pool.h"
+#include "epoch.h"
+#include "order_stat.h"
+
+#ifdef BST_SUBTREE_SIZE
+
+typedef struct _order_arg
+{
+	node *root;
+	int *keys;
+	int *ranks;
+	node **found_keys;
+} order_arg;
+
+static inline int size_of(node *tmp_node)
+{
+	return tmp_node ? tmp_node->size : 0;
+}
+
+/* Number of keys in the tree smaller than key. */
+int rank_node(node *root, int key)
+{
+	node *tmp_node = root;
+	int rank = 0;
+
+	while (tmp_node) {
+		if (key <= tmp_node->value) {
+			tmp_node = tmp_node->left;
+		}
+		else {
+			rank += tmp_node->size - size_of(tmp_node->right);
+			tmp_node = tmp_node->right;
+		}
+	}
+
+	return rank;
+}
+
+/* Node of the key with rank k, the (k + 1)th smallest key. NULL if k is
+ * not in [0, count_node(root)). */
+node *select_node(node *root, int k)
+{
+	node *tmp_node = root;
+	int left_size, own;
+
+	while (tmp_node) {
+		left_size = size_of(tmp_node->left);
+		own = !tmp_node->deleted;
+
+		if (k < left_size) {
+			tmp_node = tmp_node->left;
+		}
+		else if (k < left_size + own) {
+			return tmp_node;
+		}
+		else {
+			k -= left_size + own;
+			tmp_node = tmp_node->right;
+		}
+	}
+
+	return NULL;
+}
+
+static void rank_range(void *arg, int begin, int end, int worker_id)
+{
+	order_arg *oarg = (order_arg *)arg;
+
+	epoch_enter();
+	for (int i = begin; i < end; i++) {
+		oarg->ranks[i] = rank_node(oarg->root, oarg->keys[i]);
+	}
+	epoch_exit();
+}
+
+static void select_range(void *arg, int begin, int end, int worker_id)
+{
+	order_arg *oarg = (order_arg *)arg;
+
+	epoch_enter();
+	for (int i = begin; i < end; i++) {
+		oarg->found_keys[i] = select_node(oarg->root, oarg->keys[i]);
+	}
+	epoch_exit();
+}
+
+/* ranks[i] is the rank of keys[i], batch split as in multithreaded_search. */
+void multithreaded_rank(node *root, int *keys, int key_array_size, int num_thread, int *ranks)
+{
+	order_arg oarg;
+
+	oarg.root = root;
+	oarg.keys = keys;
+	oarg.ranks = ranks;
+
+	thread_pool_init(num_thread);
+	thread_pool_run(rank_range, &oarg, key_array_size);
+}
+
+/* found_keys[i] is the node of rank ranks[i]. */
+void multithreaded_select(node *root, int *ranks, int key_array_size, int num_thread, node **found_keys)
+{
+	order_arg oarg;
+
+	oarg.root = root;
+	oarg.keys = ranks;
+	oarg.found_keys = found_keys;
+
+	thread_pool_init(num_thread);
+	thread_pool_run(select_range, &oarg, key_array_size);
+}
+
+int order_stat_available(void)
+{
+	return 1;
+}
+
+#else /* BST_SUBTREE_SIZE */
+
+int order_stat_available(void)
+{
+	return 0;
+}
+
+int rank_node(node *root, int key)
+{
+	return 0;
+}
+
+node *select_node(node *root, int k)
+{
+	return NULL;
+}
+
+void multithreaded_rank(node *root, int *keys, int key_array_size, int num_thread, int *ranks)
+{
+}
+
+void multithreaded_select(node *root, int *ranks, int key_array_size, int num_thread, node **found_keys)
+{
+}
+
+#endif /* BST_SUBTREE_SIZE */
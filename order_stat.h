@@ -0,0 +1,18 @@
+#ifndef ORDER_STAT_H_
+#define ORDER_STAT_H_
+
+#include "hsa_BST_search.h"
+
+/* Order statistic queries run by the driver (-k) */
+#define ORDER_NONE		0
+#define ORDER_RANK		1	// number of keys smaller than the search key
+#define ORDER_SELECT	2	// key of the given rank
+
+/* Rank and select read the subtree sizes of BST_SUBTREE_SIZE. */
+int order_stat_available(void);
+int rank_node(node *root, int key);
+node *select_node(node *root, int k);
+void multithreaded_rank(node *root, int *keys, int key_array_size, int num_thread, int *ranks);
+void multithreaded_select(node *root, int *ranks, int key_array_size, int num_thread, node **found_keys);
+
+#endif
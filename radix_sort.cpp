@@ -0,0 +1,260 @@
+/*******************************************************************************
+Copyright 2013 Advanced Micro Devices, Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1 Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+2 Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+/**
+********************************************************************************
+* @file <radix_sort.cpp>
+*
+* @brief This file contains the parallel LSD radix sort of search keys.
+* Every pass splits the array into one chunk per pool worker, counts the
+* digits of each chunk, turns the counts into per chunk bucket offsets and
+* scatters the chunks stably into the other buffer. Passes whose digit is
+* the same for every key are skipped, so keys with few significant bits
+* take fewer passes. The sort can also return the permutation it applied.
+*
+********************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "thread_pool.h"
+#include "radix_sort.h"
+
+typedef struct _radix_arg
+{
+	const int *src_keys;
+	const int *src_perm;	// NULL for the identity permutation
+	int *dst_keys;
+	int *dst_perm;			// NULL when no permutation is wanted
+	int n;
+	int chunk;				// keys per chunk
+	int shift;
+	unsigned int flip;		// flips the sign bit in the top digit
+	int (*counts)[RADIX_SIZE];	// one histogram, then offsets, per chunk
+} radix_arg;
+
+static int *tmp_keys = NULL;
+static int *tmp_perm = NULL;
+static int tmp_size = 0;
+
+static int (*chunk_counts)[RADIX_SIZE] = NULL;
+static int (*digit_counts)[RADIX_PASSES][RADIX_SIZE] = NULL;
+static int num_chunk_counts = 0;
+
+static inline int radix_digit(int key, int shift, unsigned int flip)
+{
+	return (int)((((unsigned int)key ^ flip) >> shift) & (RADIX_SIZE - 1));
+}
+
+static inline void chunk_bounds(const radix_arg *rarg, int c, int *begin, int *end)
+{
+	long long b = (long long)c * rarg->chunk;
+	long long e = b + rarg->chunk;
+
+	*begin = (b < rarg->n) ? (int)b : rarg->n;
+	*end = (e < rarg->n) ? (int)e : rarg->n;
+}
+
+/* Counts every digit of the chunk in one read, used to find the passes that
+ * would leave the keys where they are. */
+static void digit_count_range(void *arg, int begin, int end, int worker_id)
+{
+	radix_arg *rarg = (radix_arg *)arg;
+	int b, e;
+
+	for (int c = begin; c < end; c++) {
+		int (*counts)[RADIX_SIZE] = digit_counts[c];
+
+		memset(counts, 0, sizeof(digit_counts[c]));
+		chunk_bounds(rarg, c, &b, &e);
+		for (int i = b; i < e; i++) {
+			unsigned int key = (unsigned int)rarg->src_keys[i] ^ 0x80000000u;
+
+			for (int p = 0; p < RADIX_PASSES; p++)
+				counts[p][(key >> (p * RADIX_BITS)) & (RADIX_SIZE - 1)]++;
+		}
+	}
+}
+
+static void count_range(void *arg, int begin, int end, int worker_id)
+{
+	radix_arg *rarg = (radix_arg *)arg;
+	int b, e;
+
+	for (int c = begin; c < end; c++) {
+		int *counts = rarg->counts[c];
+
+		memset(counts, 0, RADIX_SIZE * sizeof(int));
+		chunk_bounds(rarg, c, &b, &e);
+		for (int i = b; i < e; i++)
+			counts[radix_digit(rarg->src_keys[i], rarg->shift, rarg->flip)]++;
+	}
+}
+
+static void scatter_range(void *arg, int begin, int end, int worker_id)
+{
+	radix_arg *rarg = (radix_arg *)arg;
+	int b, e, d, pos;
+
+	for (int c = begin; c < end; c++) {
+		int *offsets = rarg->counts[c];
+
+		chunk_bounds(rarg, c, &b, &e);
+		for (int i = b; i < e; i++) {
+			d = radix_digit(rarg->src_keys[i], rarg->shift, rarg->flip);
+			pos = offsets[d]++;
+			rarg->dst_keys[pos] = rarg->src_keys[i];
+			if (rarg->dst_perm)
+				rarg->dst_perm[pos] = rarg->src_perm ? rarg->src_perm[i] : i;
+		}
+	}
+}
+
+static void copy_range(void *arg, int begin, int end, int worker_id)
+{
+	radix_arg *rarg = (radix_arg *)arg;
+
+	memcpy(rarg->dst_keys + begin, rarg->src_keys + begin, (end - begin) * sizeof(int));
+	if (rarg->dst_perm)
+		memcpy(rarg->dst_perm + begin, rarg->src_perm + begin, (end - begin) * sizeof(int));
+}
+
+static void identity_range(void *arg, int begin, int end, int worker_id)
+{
+	int *perm = (int *)arg;
+
+	for (int i = begin; i < end; i++)
+		perm[i] = i;
+}
+
+static void alloc_buffers(int n, int num_chunks)
+{
+	if (n > tmp_size) {
+		free(tmp_keys);
+		free(tmp_perm);
+		if ((tmp_keys = (int *)malloc(n * sizeof(int))) == NULL ||
+			(tmp_perm = (int *)malloc(n * sizeof(int))) == NULL) {
+			printf("Error allocating memory for radix sort.\n");
+			exit(1);
+		}
+		tmp_size = n;
+	}
+
+	if (num_chunks > num_chunk_counts) {
+		free(chunk_counts);
+		free(digit_counts);
+		if ((chunk_counts = (int (*)[RADIX_SIZE])malloc(num_chunks * sizeof(*chunk_counts))) == NULL ||
+			(digit_counts = (int (*)[RADIX_PASSES][RADIX_SIZE])malloc(num_chunks * sizeof(*digit_counts))) == NULL) {
+			printf("Error allocating memory for radix sort.\n");
+			exit(1);
+		}
+		num_chunk_counts = num_chunks;
+	}
+}
+
+/* Sorts the n keys in ascending order on the thread pool, at the size it was
+ * last initialized to. If perm is not NULL, perm[i] is set to the position
+ * the i-th sorted key had in the unsorted array. */
+void radix_sort(int *keys, int *perm, int n)
+{
+	radix_arg rarg;
+	int num_chunks, sum, p, c, d;
+	int *src_keys = keys, *src_perm = NULL;
+
+	if (n <= 0)
+		return;
+
+	num_chunks = thread_pool_size() ? thread_pool_size() : 1;
+	alloc_buffers(n, num_chunks);
+
+	rarg.n = n;
+	rarg.chunk = (n + num_chunks - 1) / num_chunks;
+	rarg.counts = chunk_counts;
+	rarg.src_keys = keys;
+	thread_pool_run(digit_count_range, &rarg, num_chunks);
+
+	for (p = 0; p < RADIX_PASSES; p++) {
+		/* Skip the pass if all the keys have the same digit */
+		for (d = 0; d < RADIX_SIZE; d++) {
+			sum = 0;
+			for (c = 0; c < num_chunks; c++)
+				sum += digit_counts[c][p][d];
+			if (sum)
+				break;
+		}
+		if (sum == n)
+			continue;
+
+		rarg.src_keys = src_keys;
+		rarg.src_perm = src_perm;
+		rarg.dst_keys = (src_keys == keys) ? tmp_keys : keys;
+		rarg.dst_perm = perm ? ((src_keys == keys) ? tmp_perm : perm) : NULL;
+		rarg.shift = p * RADIX_BITS;
+		rarg.flip = (p == RADIX_PASSES - 1) ? 0x80000000u : 0;
+		thread_pool_run(count_range, &rarg, num_chunks);
+
+		/* Bucket d of chunk c starts after the smaller digits of all the
+		 * chunks and digit d of the chunks before c */
+		sum = 0;
+		for (d = 0; d < RADIX_SIZE; d++) {
+			for (c = 0; c < num_chunks; c++) {
+				int count = chunk_counts[c][d];
+				chunk_counts[c][d] = sum;
+				sum += count;
+			}
+		}
+
+		thread_pool_run(scatter_range, &rarg, num_chunks);
+
+		src_keys = rarg.dst_keys;
+		src_perm = rarg.dst_perm;
+	}
+
+	if (src_keys != keys) {
+		rarg.src_keys = src_keys;
+		rarg.src_perm = src_perm;
+		rarg.dst_keys = keys;
+		rarg.dst_perm = perm;
+		thread_pool_run(copy_range, &rarg, n);
+	}
+	else if (perm && !src_perm) {
+		thread_pool_run(identity_range, perm, n);
+	}
+}
+
+void radix_sort_release(void)
+{
+	free(tmp_keys);
+	free(tmp_perm);
+	free(chunk_counts);
+	free(digit_counts);
+	tmp_keys = NULL;
+	tmp_perm = NULL;
+	chunk_counts = NULL;
+	digit_counts = NULL;
+	tmp_size = 0;
+	num_chunk_counts = 0;
+}
@@ -0,0 +1,12 @@
+#ifndef RADIX_SORT_H_
+#define RADIX_SORT_H_
+
+/* Bits of the key sorted by one pass, 4 passes cover an int */
+#define RADIX_BITS 8
+#define RADIX_SIZE (1 << RADIX_BITS)
+#define RADIX_PASSES ((int)(8 * sizeof(int) / RADIX_BITS))
+
+void radix_sort(int *keys, int *perm, int n);
+void radix_sort_release(void);
+
+#endif
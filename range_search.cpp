@@ -0,0 +1,199 @@
+/*******************************************************************************
+Copyright 2013 Advanced Micro Devices, Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1 Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+2 Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+/**
+********************************************************************************
+* @file <range_search.cpp>
+*
+* @brief This file contains the [lo, hi) range queries on the cpu. A range
+* starts at the lower bound of lo and walks the keys in order with the parent
+* links, so the iterator needs neither a stack nor recursion and can be
+* stopped and resumed at any node. A batch of ranges is split over the thread
+* pool. The scan runs in two passes, the counts of the first give each range
+* its offset in one packed array of results that the second pass fills.
+*
+********************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include "cpu_BST.h"
+#include "thread_pool.h"
+#include "epoch.h"
+#include "bound_search.h"
+#include "range_search.h"
+
+typedef struct _range_arg
+{
+	node *root;
+	int *lo;
+	int *hi;
+	int *counts;
+	int *offsets;
+	node **results;
+} range_arg;
+
+/* Packed results of the last multithreaded_range_scan */
+static node **scan_results = NULL;
+static long long scan_size = 0;
+
+/* First live node of the range [lo, hi), NULL if the range is empty. */
+node *range_first(node *root, int lo, int hi)
+{
+	node *tmp_node = bound_node(root, lo, BOUND_LOWER);
+
+	return (tmp_node && tmp_node->value < hi) ? tmp_node : NULL;
+}
+
+/* Live node after tmp_node in the range [., hi), NULL at the end. */
+node *range_next(node *tmp_node, int hi)
+{
+	do {
+		tmp_node = next_inorder(tmp_node);
+	} while (tmp_node && bst_load_int(&tmp_node->deleted));
+
+	return (tmp_node && tmp_node->value < hi) ? tmp_node : NULL;
+}
+
+int range_count(node *root, int lo, int hi)
+{
+	int count = 0;
+
+	for (node *tmp_node = range_first(root, lo, hi); tmp_node; tmp_node = range_next(tmp_node, hi))
+		count++;
+
+	return count;
+}
+
+/* Writes the nodes of the range to results in key order, returns their
+ * number. */
+int range_scan(node *root, int lo, int hi, node **results)
+{
+	int count = 0;
+
+	for (node *tmp_node = range_first(root, lo, hi); tmp_node; tmp_node = range_next(tmp_node, hi))
+		results[count++] = tmp_node;
+
+	return count;
+}
+
+static void count_range(void *arg, int begin, int end, int worker_id)
+{
+	range_arg *rarg = (range_arg *)arg;
+
+	epoch_enter();
+	for (int i = begin; i < end; i++) {
+		rarg->counts[i] = range_count(rarg->root, rarg->lo[i], rarg->hi[i]);
+	}
+	epoch_exit();
+}
+
+static void scan_range(void *arg, int begin, int end, int worker_id)
+{
+	range_arg *rarg = (range_arg *)arg;
+
+	epoch_enter();
+	for (int i = begin; i < end; i++) {
+		range_scan(rarg->root, rarg->lo[i], rarg->hi[i], rarg->results + rarg->offsets[i]);
+	}
+	epoch_exit();
+}
+
+/* Counts the keys of every range [lo[i], hi[i]) into counts[i]. */
+void multithreaded_range_count(node *root, int *lo, int *hi, int num_ranges, int num_thread, int *counts)
+{
+	range_arg rarg;
+
+	rarg.root = root;
+	rarg.lo = lo;
+	rarg.hi = hi;
+	rarg.counts = counts;
+
+	thread_pool_init(num_thread);
+	thread_pool_run(count_range, &rarg, num_ranges);
+}
+
+/* Turns the counts of num_ranges ranges into their offsets in one packed
+ * array, in place, and stores the total in counts[num_ranges]. The offsets
+ * are int, as in ocl_range_scan, so a total above INT_MAX is an error. */
+int range_prefix_offsets(int *counts, int num_ranges)
+{
+	long long total = 0;
+	int count;
+
+	for (int i = 0; i < num_ranges; i++) {
+		count = counts[i];
+		counts[i] = (int)total;
+		total += count;
+	}
+
+	if (total > INT_MAX) {
+		printf("Error: %lld range results do not fit the int offsets.\n", total);
+		exit(1);
+	}
+	counts[num_ranges] = (int)total;
+
+	return (int)total;
+}
+
+/* Scans every range [lo[i], hi[i]). offsets has num_ranges + 1 entries, the
+ * nodes of range i are at [offsets[i], offsets[i + 1]) of the returned
+ * array, which stays valid until the next scan or range_search_release().
+ * The tree must not change between the two passes. */
+node **multithreaded_range_scan(node *root, int *lo, int *hi, int num_ranges, int num_thread, int *offsets)
+{
+	range_arg rarg;
+	int total;
+
+	multithreaded_range_count(root, lo, hi, num_ranges, num_thread, offsets);
+	total = range_prefix_offsets(offsets, num_ranges);
+
+	if (total > scan_size) {
+		range_search_release();
+		if ((scan_results = (node **)malloc(total * sizeof(node *))) == NULL) {
+			printf("Error allocating memory for the range scan.\n");
+			exit(1);
+		}
+		scan_size = total;
+	}
+
+	rarg.root = root;
+	rarg.lo = lo;
+	rarg.hi = hi;
+	rarg.offsets = offsets;
+	rarg.results = scan_results;
+
+	thread_pool_run(scan_range, &rarg, num_ranges);
+
+	return scan_results;
+}
+
+void range_search_release(void)
+{
+	free(scan_results);
+	scan_results = NULL;
+	scan_size = 0;
+}
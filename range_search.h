@@ -0,0 +1,15 @@
+#ifndef RANGE_SEARCH_H_
+#define RANGE_SEARCH_H_
+
+#include "hsa_BST_search.h"
+
+node *range_first(node *root, int lo, int hi);
+node *range_next(node *tmp_node, int hi);
+int range_count(node *root, int lo, int hi);
+int range_scan(node *root, int lo, int hi, node **results);
+void multithreaded_range_count(node *root, int *lo, int *hi, int num_ranges, int num_thread, int *counts);
+int range_prefix_offsets(int *counts, int num_ranges);
+node **multithreaded_range_scan(node *root, int *lo, int *hi, int num_ranges, int num_thread, int *offsets);
+void range_search_release(void);
+
+#endif
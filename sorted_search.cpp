@@ -0,0 +1,229 @@
+/*******************************************************************************
+Copyright 2013 Advanced Micro Devices, Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1 Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+2 Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+/**
+********************************************************************************
+* @file <sorted_search.cpp>
+*
+* @brief This file contains the sorted batch search on the cpu.
+* The keys of the batch are radix sorted together with their position in
+* the batch, then each thread resolves a run of sorted keys with a finger
+* search: the path to the previous key is kept and the next key restarts
+* from the deepest node on that path whose key range still contains it.
+* Neighbouring keys share most of their path, so the top of the tree is
+* walked once per run instead of once per key. The results are scattered
+* back to the original order of the batch.
+*
+********************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <chrono>
+#include "cpu_BST.h"
+#include "thread_pool.h"
+#include "radix_sort.h"
+#include "epoch.h"
+#include "sorted_search.h"
+
+/* A node on the current path and the open range (lo, hi) of keys whose
+ * search from the root goes through it. */
+typedef struct _path_entry
+{
+	node *tree_node;
+	long long lo;
+	long long hi;
+} path_entry;
+
+typedef struct _resolve_arg
+{
+	node *root;
+	int *keys;
+	int *perm;
+	node **found_keys;
+} resolve_arg;
+
+/* Batch keys in sorted order and their position in the batch */
+static int *sorted_keys = NULL;
+static int *sorted_perm = NULL;
+static int sorted_size = 0;
+
+static long long sort_ns = 0;
+static long long resolve_ns = 0;
+static long long num_batches = 0;
+
+static inline long long now_ns(void)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void resolve_range(void *arg, int begin, int end, int worker_id)
+{
+	resolve_arg *rarg = (resolve_arg *)arg;
+	path_entry path[SORTED_SEARCH_MAX_PATH];
+	int depth = 0;
+	node *tmp_node = NULL;
+	node *result = NULL;
+	long long lo, hi;
+	int key, prev_key = 0;
+
+	epoch_enter();
+	for (int i = begin; i < end; i++) {
+		key = rarg->keys[i];
+
+		if (i == begin || key != prev_key) {
+			/* Back up to the deepest node the key still goes through */
+			while (depth && !(path[depth - 1].lo < key && key < path[depth - 1].hi))
+				depth--;
+
+			if (depth) {
+				tmp_node = path[depth - 1].tree_node;
+				lo = path[depth - 1].lo;
+				hi = path[depth - 1].hi;
+			}
+			else {
+				tmp_node = rarg->root;
+				lo = LLONG_MIN;
+				hi = LLONG_MAX;
+				if (tmp_node) {
+					path[0].tree_node = tmp_node;
+					path[0].lo = lo;
+					path[0].hi = hi;
+					depth = 1;
+				}
+			}
+
+			result = NULL;
+			while (tmp_node) {
+				if (tmp_node->value == key) {
+					result = bst_load_int(&tmp_node->deleted) ? search_deleted_equal(tmp_node, key) : tmp_node;
+					break;
+				}
+
+				if (key < tmp_node->value) {
+					hi = tmp_node->value;
+					tmp_node = bst_load_ptr(&tmp_node->left);
+				}
+				else {
+					lo = tmp_node->value;
+					tmp_node = bst_load_ptr(&tmp_node->right);
+				}
+
+				/* Past the end of the path buffer the walk goes on
+				 * without recording, the next key restarts higher up */
+				if (tmp_node && depth < SORTED_SEARCH_MAX_PATH) {
+					path[depth].tree_node = tmp_node;
+					path[depth].lo = lo;
+					path[depth].hi = hi;
+					depth++;
+				}
+			}
+
+			prev_key = key;
+		}
+
+		rarg->found_keys[rarg->perm[i]] = result;
+	}
+	epoch_exit();
+}
+
+/* Searches the batch in sorted key order, found_keys[i] is the result for
+ * keys[i] as with multithreaded_search. The time spent sorting and
+ * searching is accumulated for sorted_search_print_stats(). */
+void sorted_search(node *root, int *keys, int key_array_size, int num_thread, node **found_keys)
+{
+	resolve_arg rarg;
+	long long start, sorted;
+
+	if (key_array_size > sorted_size) {
+		sorted_search_release();
+		if ((sorted_keys = (int *)malloc(key_array_size * sizeof(int))) == NULL ||
+			(sorted_perm = (int *)malloc(key_array_size * sizeof(int))) == NULL) {
+			printf("Error allocating memory for the sorted search.\n");
+			exit(1);
+		}
+		sorted_size = key_array_size;
+	}
+
+	thread_pool_init(num_thread);
+
+	start = now_ns();
+	memcpy(sorted_keys, keys, key_array_size * sizeof(int));
+	radix_sort(sorted_keys, sorted_perm, key_array_size);
+	sorted = now_ns();
+
+	rarg.root = root;
+	rarg.keys = sorted_keys;
+	rarg.perm = sorted_perm;
+	rarg.found_keys = found_keys;
+	thread_pool_run(resolve_range, &rarg, key_array_size);
+
+	sort_ns += sorted - start;
+	resolve_ns += now_ns() - sorted;
+	num_batches++;
+}
+
+void sorted_search_release(void)
+{
+	free(sorted_keys);
+	free(sorted_perm);
+	sorted_keys = NULL;
+	sorted_perm = NULL;
+	sorted_size = 0;
+}
+
+void sorted_search_reset_stats(void)
+{
+	sort_ns = 0;
+	resolve_ns = 0;
+	num_batches = 0;
+}
+
+/* Prints the average cost of a sorted batch. unsorted_ms is the time of the
+ * same batch searched in arrival order, the sort pays off when the sorted
+ * search saves more than the sort costs. */
+void sorted_search_print_stats(double unsorted_ms)
+{
+	double sort_ms, resolve_ms;
+
+	if (!num_batches)
+		return;
+
+	sort_ms = sort_ns / 1e6 / num_batches;
+	resolve_ms = resolve_ns / 1e6 / num_batches;
+
+	printf("Sorted batch: sort %.4f ms + search %.4f ms = %.4f ms, unsorted search %.4f ms\n",
+		sort_ms, resolve_ms, sort_ms + resolve_ms, unsorted_ms);
+	if (sort_ms + resolve_ms < unsorted_ms)
+		printf("Sorting pays off: %.4f ms saved per batch\n", unsorted_ms - sort_ms - resolve_ms);
+	else if (resolve_ms < unsorted_ms)
+		printf("Sorting does not pay off: the search saves %.4f ms but the sort costs %.4f ms\n",
+			unsorted_ms - resolve_ms, sort_ms);
+	else
+		printf("Sorting does not pay off: the sorted search is not faster\n");
+}
@@ -0,0 +1,14 @@
+#ifndef SORTED_SEARCH_H_
+#define SORTED_SEARCH_H_
+
+#include "hsa_BST_search.h"
+
+/* Deepest path from the root kept for reuse by the next key of the batch. */
+#define SORTED_SEARCH_MAX_PATH 128
+
+void sorted_search(node *root, int *keys, int key_array_size, int num_thread, node **found_keys);
+void sorted_search_release(void);
+void sorted_search_reset_stats(void);
+void sorted_search_print_stats(double unsorted_ms);
+
+#endif
@@ -0,0 +1,412 @@
+/*******************************************************************************
+Copyright 2013 Advanced Micro Devices, Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1 Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+2 Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+/**
+********************************************************************************
+* @file <thread_pool.cpp>
+*
+* @brief This file contains a persistent pool of cpu worker threads.
+* The workers are created once, pinned to cores and reused for every
+* batch handed to thread_pool_run(). A batch is balanced between the
+* workers by work stealing on per-worker deques of item ranges.
+*
+********************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include "thread_pool.h"
+
+/* Number of polls of the job counter before an idle worker goes to sleep on
+ * the condition variable. Back to back batches are picked up while the
+ * workers are still polling, so dispatch costs microseconds, not a wakeup. */
+#define POOL_SPIN_COUNT 20000
+
+/* Upper bound on the number of items a worker takes from its deque at once. */
+#define POOL_MAX_GRAIN 256
+
+/* Every worker owns a deque of items [begin, end) packed in one 64 bit word.
+ * The owner pops grain sized chunks from the front, thieves split off the
+ * back half of the range. Both sides update it with a single CAS. The
+ * struct is padded so that two deques never share a cache line. */
+typedef struct _pool_deque
+{
+	std::atomic<unsigned long long> range;
+	char pad[64 - sizeof(std::atomic<unsigned long long>)];
+} pool_deque;
+
+typedef struct _pool_stats
+{
+	long long busy_ns;
+	long long items;
+	long long steals;
+	char pad[64 - 3 * sizeof(long long)];
+} pool_stats;
+
+static std::thread *workers = NULL;
+static int *worker_cpu = NULL;
+static int num_workers = 0;
+
+#ifdef _WIN32
+static DWORD_PTR caller_affinity = 0;
+#else
+static cpu_set_t caller_affinity;
+#endif
+
+static std::mutex pool_lock;
+static std::condition_variable pool_cv;
+static std::atomic<unsigned int> job_generation(0);
+static std::atomic<int> job_pending(0);
+static std::atomic<int> num_sleepers(0);
+static std::atomic<int> pool_quit(0);
+
+static thread_pool_fn job_fn = NULL;
+static void *job_arg = NULL;
+static int job_items = 0;
+static int job_grain = 1;
+
+static pool_deque *deques = NULL;
+static pool_stats *stats = NULL;
+static long long total_wall_ns = 0;
+static long long total_jobs = 0;
+
+static inline unsigned long long pack_range(int begin, int end)
+{
+	return ((unsigned long long)(unsigned int)begin << 32) | (unsigned int)end;
+}
+
+static inline int range_begin(unsigned long long range)
+{
+	return (int)(range >> 32);
+}
+
+static inline int range_end(unsigned long long range)
+{
+	return (int)(range & 0xffffffffULL);
+}
+
+static inline long long now_ns(void)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int pin_thread(void *handle, int cpu)
+{
+#ifdef _WIN32
+	return SetThreadAffinityMask((HANDLE)handle, (DWORD_PTR)1 << cpu) != 0;
+#else
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return pthread_setaffinity_np((pthread_t)handle, sizeof(set), &set) == 0;
+#endif
+}
+
+/* Worker 0 is the calling thread, the items are split evenly and the
+ * first (num_items % num_workers) workers take one extra item each. This is
+ * only the initial distribution, idle workers steal from the others. */
+static void worker_range(int worker_id, int *begin, int *end)
+{
+	int chunk = job_items / num_workers;
+	int rem = job_items % num_workers;
+
+	*begin = worker_id * chunk + ((worker_id < rem) ? worker_id : rem);
+	*end = *begin + chunk + ((worker_id < rem) ? 1 : 0);
+}
+
+/* Pop up to job_grain items from the front of the worker's own deque. */
+static int take_chunk(int worker_id, int *begin, int *end)
+{
+	std::atomic<unsigned long long> *range = &deques[worker_id].range;
+	unsigned long long cur = range->load(std::memory_order_acquire);
+
+	while (1) {
+		int b = range_begin(cur);
+		int e = range_end(cur);
+		if (b >= e)
+			return 0;
+
+		int nb = (e - b > job_grain) ? b + job_grain : e;
+		if (range->compare_exchange_weak(cur, pack_range(nb, e), std::memory_order_acq_rel)) {
+			*begin = b;
+			*end = nb;
+			return 1;
+		}
+	}
+}
+
+/* Steal the back half of a victim's deque into the thief's own deque.
+ * Ranges not larger than one grain are left to their owner. */
+static int steal_half(int thief_id)
+{
+	for (int i = 1; i < num_workers; i++) {
+		int victim = (thief_id + i) % num_workers;
+		std::atomic<unsigned long long> *range = &deques[victim].range;
+		unsigned long long cur = range->load(std::memory_order_acquire);
+
+		while (1) {
+			int b = range_begin(cur);
+			int e = range_end(cur);
+			if (e - b <= job_grain)
+				break;
+
+			int mid = b + (e - b) / 2;
+			if (range->compare_exchange_weak(cur, pack_range(b, mid), std::memory_order_acq_rel)) {
+				deques[thief_id].range.store(pack_range(mid, e), std::memory_order_release);
+				stats[thief_id].steals++;
+				return 1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static void run_job(int worker_id)
+{
+	int begin, end;
+	long long start;
+
+	do {
+		while (take_chunk(worker_id, &begin, &end)) {
+			start = now_ns();
+			job_fn(job_arg, begin, end, worker_id);
+			stats[worker_id].busy_ns += now_ns() - start;
+			stats[worker_id].items += end - begin;
+		}
+	} while (steal_half(worker_id));
+}
+
+static void worker_main(int worker_id, unsigned int seen)
+{
+	unsigned int gen;
+	int spins;
+
+	while (1) {
+		spins = 0;
+		while ((gen = job_generation.load(std::memory_order_acquire)) == seen) {
+			if (pool_quit.load(std::memory_order_relaxed))
+				return;
+
+			if (++spins < POOL_SPIN_COUNT) {
+				std::this_thread::yield();
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(pool_lock);
+			num_sleepers.fetch_add(1);
+			while (job_generation.load() == seen && !pool_quit.load())
+				pool_cv.wait(lock);
+			num_sleepers.fetch_sub(1);
+			spins = 0;
+		}
+
+		seen = gen;
+		run_job(worker_id);
+		job_pending.fetch_sub(1, std::memory_order_release);
+	}
+}
+
+void thread_pool_init(int num_thread)
+{
+	if (num_thread < 1)
+		num_thread = 1;
+
+	if (num_thread == num_workers)
+		return;
+
+	thread_pool_release();
+
+	int num_cpus = (int)std::thread::hardware_concurrency();
+	if (num_cpus < 1)
+		num_cpus = 1;
+
+	workers = new std::thread[num_thread];
+	deques = new pool_deque[num_thread];
+
+	if ((worker_cpu = (int *)malloc(sizeof(int) * num_thread)) == NULL) {
+		printf("Error allocating memory for thread pool.\n");
+		exit(1);
+	}
+
+	if ((stats = (pool_stats *)calloc(num_thread, sizeof(pool_stats))) == NULL) {
+		printf("Error allocating memory for thread pool stats.\n");
+		exit(1);
+	}
+
+	for (int i = 0; i < num_thread; i++)
+		deques[i].range.store(0);
+
+	num_workers = num_thread;
+	total_wall_ns = 0;
+	total_jobs = 0;
+	pool_quit.store(0);
+
+	/* The calling thread works as worker 0 and is pinned for the lifetime
+	 * of the pool. Its original affinity is restored on release. */
+#ifdef _WIN32
+	caller_affinity = SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1);
+	worker_cpu[0] = (caller_affinity != 0) ? 0 : -1;
+#else
+	pthread_getaffinity_np(pthread_self(), sizeof(caller_affinity), &caller_affinity);
+	worker_cpu[0] = pin_thread((void *)pthread_self(), 0) ? 0 : -1;
+#endif
+
+	unsigned int gen = job_generation.load();
+	for (int i = 1; i < num_thread; i++) {
+		workers[i] = std::thread(worker_main, i, gen);
+		worker_cpu[i] = pin_thread((void *)workers[i].native_handle(), i % num_cpus) ? (i % num_cpus) : -1;
+	}
+}
+
+void thread_pool_run(thread_pool_fn fn, void *arg, int num_items)
+{
+	if (num_items <= 0)
+		return;
+
+	if (!num_workers)
+		thread_pool_init(1);
+
+	long long start = now_ns();
+	int begin, end;
+
+	job_fn = fn;
+	job_arg = arg;
+	job_items = num_items;
+	job_grain = num_items / (num_workers * 16);
+	if (job_grain < 1)
+		job_grain = 1;
+	else if (job_grain > POOL_MAX_GRAIN)
+		job_grain = POOL_MAX_GRAIN;
+
+	for (int i = 0; i < num_workers; i++) {
+		worker_range(i, &begin, &end);
+		deques[i].range.store(pack_range(begin, end), std::memory_order_relaxed);
+	}
+
+	job_pending.store(num_workers - 1, std::memory_order_relaxed);
+	job_generation.fetch_add(1);
+
+	if (num_sleepers.load() > 0) {
+		std::lock_guard<std::mutex> lock(pool_lock);
+		pool_cv.notify_all();
+	}
+
+	run_job(0);
+
+	while (job_pending.load(std::memory_order_acquire) > 0)
+		std::this_thread::yield();
+
+	total_wall_ns += now_ns() - start;
+	total_jobs++;
+}
+
+void thread_pool_release(void)
+{
+	if (!num_workers)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(pool_lock);
+		pool_quit.store(1);
+		pool_cv.notify_all();
+	}
+
+	for (int i = 1; i < num_workers; i++)
+		workers[i].join();
+
+#ifdef _WIN32
+	if (caller_affinity)
+		SetThreadAffinityMask(GetCurrentThread(), caller_affinity);
+#else
+	pthread_setaffinity_np(pthread_self(), sizeof(caller_affinity), &caller_affinity);
+#endif
+
+	delete [] workers;
+	delete [] deques;
+	free(worker_cpu);
+	free(stats);
+	workers = NULL;
+	deques = NULL;
+	worker_cpu = NULL;
+	stats = NULL;
+	num_workers = 0;
+}
+
+int thread_pool_size(void)
+{
+	return num_workers;
+}
+
+int thread_pool_worker_cpu(int worker_id)
+{
+	if (worker_id < 0 || worker_id >= num_workers)
+		return -1;
+
+	return worker_cpu[worker_id];
+}
+
+void thread_pool_reset_stats(void)
+{
+	for (int i = 0; i < num_workers; i++) {
+		stats[i].busy_ns = 0;
+		stats[i].items = 0;
+		stats[i].steals = 0;
+	}
+
+	total_wall_ns = 0;
+	total_jobs = 0;
+}
+
+/* Busy is the time spent inside the work function. Idle is the rest of the
+ * wall time of the batches: dispatch latency, stealing and waiting for the
+ * slowest worker. */
+void thread_pool_print_stats(void)
+{
+	if (!num_workers || !total_jobs)
+		return;
+
+	printf("Thread pool: %lld batches, %.4f ms wall time\n", total_jobs, total_wall_ns / 1e6);
+	for (int i = 0; i < num_workers; i++) {
+		long long idle_ns = total_wall_ns - stats[i].busy_ns;
+		if (idle_ns < 0)
+			idle_ns = 0;
+
+		printf("  worker %2d (cpu %2d): busy %.4f ms, idle %.4f ms, items %lld, steals %lld\n",
+			i, worker_cpu[i], stats[i].busy_ns / 1e6, idle_ns / 1e6, stats[i].items, stats[i].steals);
+	}
+}
@@ -0,0 +1,16 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+/* Work function run by the pool. [begin, end) is the item range handed to
+ * the worker and worker_id is in [0, thread_pool_size()). */
+typedef void (*thread_pool_fn)(void *arg, int begin, int end, int worker_id);
+
+void thread_pool_init(int num_thread);
+void thread_pool_run(thread_pool_fn fn, void *arg, int num_items);
+void thread_pool_release(void);
+int thread_pool_size(void);
+int thread_pool_worker_cpu(int worker_id);
+void thread_pool_reset_stats(void);
+void thread_pool_print_stats(void);
+
+#endif
@@ -0,0 +1,153 @@
+/*******************************************************************************
+Copyright 2013 Advanced Micro Devices, Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1 Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+2 Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+/**
+********************************************************************************
+* @file <top_levels.cpp>
+*
+* @brief This file contains the replica of the top levels of the pointer
+* tree. Every search goes through the first levels, whose nodes are spread
+* over the node pool one per cache line. The replica packs their keys in a
+* small implicit array that stays in the cache, the pointer tree engines
+* descend it first and only walk the nodes below it.
+*
+********************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "cpu_BST.h"
+#include "top_levels.h"
+
+/* Copies the subtree of tree_node into slot i. Below a missing node every
+ * slot gets fill_key, which no search that reaches it can pass with a
+ * match on a live node, and the exits stay NULL. */
+static void fill_slots(top_levels *top, node *tree_node, unsigned int i, int fill_key)
+{
+	if (i >= top->num_slots) {
+		top->nodes[i] = tree_node;
+		return;
+	}
+
+	if (!tree_node) {
+		top->keys[i] = fill_key;
+		fill_slots(top, NULL, 2 * i, fill_key);
+		fill_slots(top, NULL, 2 * i + 1, fill_key);
+		return;
+	}
+
+	top->keys[i] = tree_node->value;
+	top->nodes[i] = tree_node;
+	fill_slots(top, tree_node->left, 2 * i, tree_node->value);
+	fill_slots(top, tree_node->right, 2 * i + 1, tree_node->value);
+}
+
+/* Builds the replica of the top levels of the tree. It is a snapshot, the
+ * tree changes are picked up by building it again. */
+top_levels *top_levels_build(node *root, int levels)
+{
+	top_levels *top;
+
+	if (levels > TOP_LEVELS_MAX)
+		levels = TOP_LEVELS_MAX;
+
+	if ((top = (top_levels *)malloc(sizeof(top_levels))) == NULL) {
+		printf("Error allocating memory for top levels.\n");
+		exit(1);
+	}
+
+	top->levels = levels;
+	top->num_slots = 1u << levels;
+
+	if ((top->keys = (int *)bst_aligned_alloc(64, top->num_slots * sizeof(int))) == NULL) {
+		printf("Error allocating memory for top level keys.\n");
+		exit(1);
+	}
+
+	if ((top->nodes = (node **)calloc(2 * top->num_slots, sizeof(node *))) == NULL) {
+		printf("Error allocating memory for top level nodes.\n");
+		exit(1);
+	}
+
+	top->keys[0] = INT_MIN;
+	fill_slots(top, root, 1, root ? root->value : 0);
+
+	return top;
+}
+
+void top_levels_release(top_levels *top)
+{
+	if (!top)
+		return;
+
+	bst_aligned_free(top->keys);
+	free(top->nodes);
+	free(top);
+}
+
+/* Number of tree nodes search_node reads from tmp_node on */
+static int path_length(node *tmp_node, int key)
+{
+	int hops = 0;
+
+	while (tmp_node) {
+		hops++;
+		if (tmp_node->value == key)
+			break;
+		tmp_node = (key < tmp_node->value) ? tmp_node->left : tmp_node->right;
+	}
+
+	return hops;
+}
+
+/* Compares the tree nodes read per search with and without the replica on
+ * a sample of the batch. Every node read is a likely cache miss, the
+ * replica keys mostly stay in the cache. */
+void top_levels_print_stats(const top_levels *top, node *root, const int *keys, int num_keys)
+{
+	long long tree_hops = 0, below_hops = 0;
+	int resolved = 0;
+	node *start;
+
+	if (!top || num_keys <= 0)
+		return;
+
+	if (num_keys > 65536)
+		num_keys = 65536;
+
+	for (int i = 0; i < num_keys; i++) {
+		tree_hops += path_length(root, keys[i]);
+		if (top_levels_descend(top, keys[i], &start))
+			resolved++;
+		else
+			below_hops += path_length(start, keys[i]);
+	}
+
+	printf("Top %d levels (%.1f KB of keys): %.2f tree nodes read per search instead of %.2f, %.2f%% of the searches end in the replica\n",
+		top->levels, top->num_slots * sizeof(int) / 1024.0,
+		(double)below_hops / num_keys, (double)tree_hops / num_keys, 100.0 * resolved / num_keys);
+}
@@ -0,0 +1,67 @@
+#ifndef TOP_LEVELS_H_
+#define TOP_LEVELS_H_
+
+#include "cpu_BST.h"
+
+/* Deepest replica, 2^20 keys of 4 bytes plus the node pointers. */
+#define TOP_LEVELS_MAX 20
+
+/* Copy of the top levels of the pointer tree in the implicit 1 based
+ * layout of eytzinger.h: keys[i] has its children at 2i and 2i + 1, so the
+ * first four levels share one line and a descent loads no child pointer.
+ * nodes[i] is the tree node of slot i, read only when the key matches.
+ * Slots below a missing child repeat the key of its parent and lead to
+ * NULL, the slots [num_slots, 2 * num_slots) of nodes are the subtrees
+ * hanging below the last level, where the search goes on in the tree. */
+typedef struct _top_levels
+{
+	int *keys;
+	node **nodes;
+	unsigned int num_slots;
+	int levels;
+} top_levels;
+
+top_levels *top_levels_build(node *root, int levels);
+void top_levels_release(top_levels *top);
+void top_levels_print_stats(const top_levels *top, node *root, const int *keys, int num_keys);
+
+/* Descends the replica. Returns 1 when the search ends in it with *result
+ * the node found or NULL, else 0 with *result the tree node the search
+ * goes on from. Follows the compares of search_node, a deleted node with
+ * the key ends the search in its subtree. */
+static inline int top_levels_descend(const top_levels *top, int key, node **result)
+{
+	const int *keys = top->keys;
+	unsigned int i = 1;
+	node *tmp_node;
+
+	while (i < top->num_slots) {
+		if (keys[i] == key) {
+			tmp_node = top->nodes[i];
+			if (tmp_node && bst_load_int(&tmp_node->deleted))
+				tmp_node = search_deleted_equal(tmp_node, key);
+			*result = tmp_node;
+			return 1;
+		}
+		i = 2 * i + (key >= keys[i]);
+	}
+
+	*result = top->nodes[i];
+
+	return *result == NULL;
+}
+
+/* Node a search of the key starts from, the root without a replica */
+static inline node *top_levels_start(const top_levels *top, node *root, int key)
+{
+	node *start;
+
+	if (!top)
+		return root;
+
+	top_levels_descend(top, key, &start);
+
+	return start;
+}
+
+#endif
@@ -0,0 +1,161 @@
+/*******************************************************************************
+Copyright 2013 Advanced Micro Devices, Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1 Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+2 Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+/**
+********************************************************************************
+* @file <veb_layout.cpp>
+*
+* @brief This file contains the van Emde Boas (cache oblivious) layout of
+* the BST. The balanced tree over the sorted keys is numbered implicitly
+* in BFS order (children of k at 2k and 2k + 1) and every BFS slot is given
+* its position in the recursive van Emde Boas order.
+*
+********************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "cpu_BST.h"
+#include "veb_layout.h"
+
+/* Assigns van Emde Boas positions to the subtree of the given height rooted
+ * at BFS slot root. Slots past num_nodes do not exist and are skipped, so
+ * the positions stay dense for any tree size. */
+static void assign_positions(int *pos, long long num_nodes, long long root, int height, int *next)
+{
+	if (root > num_nodes)
+		return;
+
+	if (height == 1) {
+		pos[root] = (*next)++;
+		return;
+	}
+
+	int top = height / 2;
+	int bottom = height - top;
+
+	assign_positions(pos, num_nodes, root, top, next);
+
+	/* The bottom subtrees hang below the last level of the top tree, their
+	 * roots are the 2^top consecutive BFS slots starting at root << top. */
+	long long first = root << top;
+	for (long long i = 0; i < (1LL << top); i++) {
+		if (first + i > num_nodes)
+			break;
+		assign_positions(pos, num_nodes, first + i, bottom, next);
+	}
+}
+
+/* In-order walk of the implicit tree, placing the next sorted key. */
+static void fill_nodes(veb_tree *veb, int *pos, node **sorted, int *next, long long k)
+{
+	if (k > veb->num_nodes)
+		return;
+
+	fill_nodes(veb, pos, sorted, next, 2 * k);
+
+	veb_node *vn = &veb->tree[pos[k]];
+	vn->value = sorted[*next]->value;
+	vn->left = (2 * k <= veb->num_nodes) ? pos[2 * k] : -1;
+	vn->right = (2 * k + 1 <= veb->num_nodes) ? pos[2 * k + 1] : -1;
+	veb->nodes[pos[k]] = sorted[*next];
+	(*next)++;
+
+	fill_nodes(veb, pos, sorted, next, 2 * k + 1);
+}
+
+veb_tree *veb_build(node **sorted, int num_nodes)
+{
+	veb_tree *veb;
+	int *pos;
+	int height = 0, next = 0;
+
+	if ((veb = (veb_tree *)malloc(sizeof(veb_tree))) == NULL) {
+		printf("Error allocating memory for veb tree.\n");
+		exit(1);
+	}
+
+	veb->num_nodes = num_nodes;
+
+	if ((veb->tree = (veb_node *)bst_aligned_alloc(64, (num_nodes + 1) * sizeof(veb_node))) == NULL) {
+		printf("Error allocating memory for veb nodes.\n");
+		exit(1);
+	}
+
+	if ((veb->nodes = (node **)malloc((num_nodes + 1) * sizeof(node *))) == NULL) {
+		printf("Error allocating memory for veb node pointers.\n");
+		exit(1);
+	}
+
+	if ((pos = (int *)malloc((num_nodes + 1) * sizeof(int))) == NULL) {
+		printf("Error allocating memory for veb positions.\n");
+		exit(1);
+	}
+
+	while ((1LL << height) <= num_nodes)
+		height++;
+
+	if (num_nodes > 0) {
+		assign_positions(pos, num_nodes, 1, height, &next);
+		next = 0;
+		fill_nodes(veb, pos, sorted, &next, 1);
+	}
+
+	free(pos);
+
+	return veb;
+}
+
+void veb_release(veb_tree *veb)
+{
+	if (!veb)
+		return;
+
+	bst_aligned_free(veb->tree);
+	free(veb->nodes);
+	free(veb);
+}
+
+node *veb_search(veb_tree *veb, int key)
+{
+	veb_node *tree = veb->tree;
+	int id = (veb->num_nodes > 0) ? 0 : -1;
+
+	while (1) {
+		if ((id == -1) || (tree[id].value == key))
+			break;
+
+		id = (key < tree[id].value) ? tree[id].left : tree[id].right;
+	}
+
+	return (id == -1) ? NULL : veb->nodes[id];
+}
+
+void veb_search_batch(veb_tree *veb, int *keys, node **found_keys, int begin, int end)
+{
+	for (int i = begin; i < end; i++) {
+		found_keys[i] = veb_search(veb, keys[i]);
+	}
+}
@@ -0,0 +1,30 @@
+#ifndef VEB_LAYOUT_H_
+#define VEB_LAYOUT_H_
+
+#include "hsa_BST_search.h"
+
+typedef struct _veb_node
+{
+	int value;
+	int left;	// index of the left child, -1 if none
+	int right;	// index of the right child, -1 if none
+} veb_node;
+
+/* Balanced tree over the sorted keys stored in van Emde Boas order: the top
+ * half of the levels is laid out first, followed by each bottom subtree,
+ * recursively. Any subtree of height h spans O(h / log B) blocks for every
+ * block size B, so the layout needs no tuning for cache line or page size.
+ * The root is at index 0 and nodes[i] is the tree node of tree[i]. */
+typedef struct _veb_tree
+{
+	veb_node *tree;
+	node **nodes;
+	int num_nodes;
+} veb_tree;
+
+veb_tree *veb_build(node **sorted, int num_nodes);
+void veb_release(veb_tree *veb);
+node *veb_search(veb_tree *veb, int key);
+void veb_search_batch(veb_tree *veb, int *keys, node **found_keys, int begin, int end);
+
+#endif
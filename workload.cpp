@@ -0,0 +1,226 @@
+/*******************************************************************************
+Copyright 2013 Advanced Micro Devices, Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1 Redistributions of source code must retain the above copyright notice,
+this list of conditions and the following disclaimer.
+2 Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+/**
+********************************************************************************
+* @file <workload.cpp>
+*
+* @brief This file contains the generator of the tree and search keys.
+* Key i of a stream is a function of (seed, stream, i) only, computed with
+* the Philox2x32-10 counter based generator, so the keys are filled on the
+* thread pool in any order and come out the same for every thread count and
+* every run with the same seed.
+*
+********************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <math.h>
+#include "thread_pool.h"
+#include "radix_sort.h"
+#include "workload.h"
+
+#define PHILOX_M0		0xD256D193U
+#define PHILOX_W0		0x9E3779B9U
+#define PHILOX_ROUNDS	10
+
+/* Terms of the Zipf normalization summed one by one, the rest of the sum is
+ * approximated by its integral */
+#define ZIPF_EXACT_TERMS 10000
+
+typedef struct _fill_arg
+{
+	const workload *w;
+	uint64_t stream;
+	int *keys;
+	double zetan;	// Zipf normalization over num_tree_keys
+	double eta;
+} fill_arg;
+
+/* Philox2x32-10 on the counter (stream, counter) with the seed as key. The
+ * stream takes the top 24 bits of the 64 bit counter. */
+uint64_t workload_random(uint64_t seed, uint64_t stream, uint64_t counter)
+{
+	uint64_t ctr = (stream << 40) ^ counter;
+	uint32_t x0 = (uint32_t)(ctr >> 32);
+	uint32_t x1 = (uint32_t)ctr;
+	uint32_t key = (uint32_t)seed ^ (uint32_t)(seed >> 32);
+	uint64_t p;
+
+	for (int r = 0; r < PHILOX_ROUNDS; r++) {
+		p = (uint64_t)PHILOX_M0 * x0;
+		x0 = (uint32_t)(p >> 32) ^ key ^ x1;
+		x1 = (uint32_t)p;
+		key += PHILOX_W0;
+	}
+
+	return ((uint64_t)x0 << 32) | x1;
+}
+
+/* Uniform double in [0, 1) from the top 53 bits */
+static inline double to_unit(uint64_t r)
+{
+	return (r >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* Key in [0, INT_MAX] from the top 31 bits */
+static inline int to_key(uint64_t r)
+{
+	return (int)(r >> 33);
+}
+
+int workload_key(uint64_t seed, uint64_t stream, uint64_t counter)
+{
+	return to_key(workload_random(seed, stream, counter));
+}
+
+void workload_init(workload *w)
+{
+	w->dist = KEY_DIST_HIT_RATIO;
+	w->seed = WORKLOAD_DEFAULT_SEED;
+	w->zipf_theta = 0.99;
+	w->num_clusters = 16;
+	w->cluster_width = 1 << 16;
+	w->hit_ratio = 0.5;
+	w->tree_keys = NULL;
+	w->num_tree_keys = 0;
+}
+
+/* sum 1 / i^theta for i in [1, n] */
+static double zeta(long long n, double theta)
+{
+	double sum = 0;
+	long long m = (n < ZIPF_EXACT_TERMS) ? n : ZIPF_EXACT_TERMS;
+
+	for (long long i = 1; i <= m; i++)
+		sum += pow((double)i, -theta);
+
+	if (n > m)
+		sum += (pow((double)n, 1 - theta) - pow((double)m, 1 - theta)) / (1 - theta);
+
+	return sum;
+}
+
+/* Rank in [0, n) of a Zipfian draw, the method of Gray et al., "Quickly
+ * generating billion-record synthetic databases". */
+static long long zipf_rank(const fill_arg *farg, long long n, double u)
+{
+	double theta = farg->w->zipf_theta;
+	double uz = u * farg->zetan;
+	long long rank;
+
+	if (uz < 1.0)
+		return 0;
+	if (uz < 1.0 + pow(0.5, theta))
+		return 1;
+
+	rank = (long long)(n * pow(farg->eta * u - farg->eta + 1, 1 / (1 - theta)));
+
+	return (rank < n) ? rank : n - 1;
+}
+
+static void fill_range(void *arg, int begin, int end, int worker_id)
+{
+	fill_arg *farg = (fill_arg *)arg;
+	const workload *w = farg->w;
+	long long num_tree = w->tree_keys ? w->num_tree_keys : 0;
+	uint64_t r, c;
+
+	for (int i = begin; i < end; i++) {
+		r = workload_random(w->seed, farg->stream, i);
+
+		switch (w->dist) {
+		case KEY_DIST_ZIPF:
+			/* The rank is hashed to the key, as in the scrambled Zipf
+			 * of YCSB. The tree keys are in key order after a bulk
+			 * load, the hot keys would all be the smallest ones. */
+			c = workload_random(w->seed, WORKLOAD_STREAM_ZIPF,
+				zipf_rank(farg, num_tree ? num_tree : INT_MAX, to_unit(r)));
+			if (num_tree)
+				farg->keys[i] = w->tree_keys[c % num_tree];
+			else
+				farg->keys[i] = to_key(c);
+			break;
+		case KEY_DIST_CLUSTERED:
+			/* Cluster starts are drawn from the nodes stream with the
+			 * counter out of the range of the node keys */
+			c = (uint32_t)r % w->num_clusters;
+			farg->keys[i] = to_key(workload_random(w->seed, WORKLOAD_STREAM_NODES, (1ULL << 39) + c));
+			if (farg->keys[i] > INT_MAX - w->cluster_width)
+				farg->keys[i] = INT_MAX - w->cluster_width;
+			farg->keys[i] += (int)((r >> 32) % w->cluster_width);
+			break;
+		case KEY_DIST_HIT_RATIO:
+			if (num_tree && to_unit(r) < w->hit_ratio) {
+				farg->keys[i] = w->tree_keys[(uint32_t)r % num_tree];
+				break;
+			}
+			farg->keys[i] = to_key(workload_random(w->seed, farg->stream ^ 0x800000, i));
+			break;
+		default:
+			farg->keys[i] = to_key(r);
+			break;
+		}
+	}
+}
+
+/* Fills keys with num_keys keys of stream following w->dist. Runs on the
+ * thread pool, which must be set up by the caller. */
+void workload_fill(const workload *w, uint64_t stream, int *keys, long long num_keys)
+{
+	fill_arg farg;
+	long long n;
+
+	farg.w = w;
+	farg.stream = stream;
+	farg.keys = keys;
+	farg.zetan = 0;
+	farg.eta = 0;
+
+	if (w->dist == KEY_DIST_ZIPF) {
+		n = (w->tree_keys && w->num_tree_keys) ? w->num_tree_keys : INT_MAX;
+		farg.zetan = zeta(n, w->zipf_theta);
+		farg.eta = (1 - pow(2.0 / n, 1 - w->zipf_theta)) / (1 - zeta(2, w->zipf_theta) / farg.zetan);
+	}
+
+	thread_pool_run(fill_range, &farg, (int)num_keys);
+
+	if (w->dist == KEY_DIST_SORTED)
+		radix_sort(keys, NULL, (int)num_keys);
+}
+
+const char *key_dist_name(int dist)
+{
+	switch (dist) {
+	case KEY_DIST_UNIFORM:		return "uniform";
+	case KEY_DIST_ZIPF:			return "zipf";
+	case KEY_DIST_SORTED:		return "sorted";
+	case KEY_DIST_CLUSTERED:	return "clustered";
+	case KEY_DIST_HIT_RATIO:	return "hit ratio";
+	default:					return "unknown";
+	}
+}
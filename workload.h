@@ -0,0 +1,46 @@
+#ifndef WORKLOAD_H_
+#define WORKLOAD_H_
+
+#include <stdint.h>
+
+/* Seed of the generator unless the driver is given another one */
+#define WORKLOAD_DEFAULT_SEED 1
+
+/* Streams of the generator. Batch b of the search keys is stream
+ * WORKLOAD_STREAM_SEARCH + b, so every batch differs and is reproducible.
+ * The Zipf ranks are hashed to keys with WORKLOAD_STREAM_ZIPF. */
+#define WORKLOAD_STREAM_NODES	0
+#define WORKLOAD_STREAM_KEYED	1
+#define WORKLOAD_STREAM_ZIPF	2
+#define WORKLOAD_STREAM_SEARCH	16
+
+/* Search key distributions */
+typedef enum _key_dist
+{
+	KEY_DIST_UNIFORM = 0,	// uniform over [0, INT_MAX]
+	KEY_DIST_ZIPF,			// Zipfian over the tree keys, the hot keys scattered
+	KEY_DIST_SORTED,		// uniform, sorted ascending
+	KEY_DIST_CLUSTERED,		// uniform inside a few narrow key ranges
+	KEY_DIST_HIT_RATIO,		// tree keys with probability hit_ratio, else uniform
+	KEY_DIST_COUNT
+} key_dist;
+
+typedef struct _workload
+{
+	int dist;
+	uint64_t seed;
+	double zipf_theta;		// skew of KEY_DIST_ZIPF, in (0, 1)
+	int num_clusters;
+	int cluster_width;
+	double hit_ratio;
+	const int *tree_keys;	// keys drawn by KEY_DIST_ZIPF and KEY_DIST_HIT_RATIO
+	long long num_tree_keys;
+} workload;
+
+uint64_t workload_random(uint64_t seed, uint64_t stream, uint64_t counter);
+int workload_key(uint64_t seed, uint64_t stream, uint64_t counter);
+void workload_init(workload *w);
+void workload_fill(const workload *w, uint64_t stream, int *keys, long long num_keys);
+const char *key_dist_name(int dist);
+
+#endif